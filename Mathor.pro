@@ -23,7 +23,8 @@ SOURCES += \
         geometry/eashape.cpp \
         main.cpp \
         main/eadrawingarea.cpp \
-        main/easession.cpp
+        main/easession.cpp \
+        main/easolverworker.cpp
 
 HEADERS += \
         geometry/eaarc.h \
@@ -33,7 +34,8 @@ HEADERS += \
         geometry/eapoint.h \
         geometry/eashape.h \
         main/eadrawingarea.h \
-        main/easession.h
+        main/easession.h \
+        main/easolverworker.h
 
 RESOURCES += qml.qrc
 
@@ -220,7 +220,7 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
                                        bool forReference) const {
     if(reference && !forReference) return;
 
-    Expr *exA = Expr::From(valA);
+    Expr *exA = valAParam.v ? Expr::From(valAParam) : Expr::From(valA);
     switch(type) {
         case Type::PT_PT_DISTANCE:
             AddEq(l, Distance(workplane, ptA, ptB)->Minus(exA), 0);
@@ -639,7 +639,9 @@ void ConstraintBase::GenerateEquations(IdList<Equation,hEquation> *l,
                 // specified angle
                 Expr *rads = exA->Times(Expr::From(PI/180)),
                      *rc   = rads->Cos();
-                double arc = fabs(rc->Eval());
+                // From valA, which is what rc evaluates to, unless that's
+                // from a param that might change after we write this.
+                double arc = fabs(cos(valA*(PI/180)));
                 // avoid false detection of inconsistent systems by gaining
                 // up as the difference in dot products gets small at small
                 // angles; doubles still have plenty of precision, only
@@ -267,8 +267,8 @@ public:
 };
 
 // A list, where each element has an integer identifier. The list is kept
-// sorted by that identifier, and items can be looked up in log n time by
-// id.
+// sorted by that identifier, and items can be looked up in constant time by
+// id, through a hash index (or, for short lists, by binary search).
 template <class T, class H>
 class IdList {
 public:
@@ -276,6 +276,50 @@ public:
     int   n;
     int   elemsAllocated;
 
+    // The index, from id to position in elem: an open-addressing hash table
+    // with 1 << indexBits slots, each the position of an element or -1 if
+    // it's empty. Everything that changes the list keeps it up to date.
+    int   *index;
+    int   indexBits;
+
+    enum { MIN_INDEXED = 16 };
+
+    int IndexSlot(uint64_t v) const {
+        // The high bits of the product, since the low bits of an id are
+        // often all zero; with the high half of a wide id folded in.
+        uint32_t f = (uint32_t)(v ^ (v >> 32));
+        return (int)((f*2654435761u) >> (32 - indexBits));
+    }
+
+    void IndexInsert(int i) {
+        int mask = (1 << indexBits) - 1;
+        int s = IndexSlot(elem[i].h.v);
+        while(index[s] >= 0) {
+            s = (s + 1) & mask;
+        }
+        index[s] = i;
+    }
+
+    void Reindex() {
+        if(n < MIN_INDEXED) {
+            if(index) MemFree(index);
+            index = NULL;
+            return;
+        }
+        // At most half full, so that probes stay short.
+        int bits = 5;
+        while((1 << bits) < 2*n) bits++;
+        if(index == NULL || bits != indexBits) {
+            if(index) MemFree(index);
+            index = (int *)MemAlloc(sizeof(int) << bits);
+            indexBits = bits;
+        }
+        memset(index, 0xff, sizeof(int) << indexBits);
+        for(int i = 0; i < n; i++) {
+            IndexInsert(i);
+        }
+    }
+
     uint32_t MaximumId() {
         if(n == 0) {
             return 0;
@@ -308,7 +352,20 @@ public:
         if(n >= elemsAllocated) {
             ReserveMore((elemsAllocated + 32)*2 - n);
         }
-    
+
+        // Lists are usually built in order, so it usually goes on the end.
+        if(n == 0 || elem[n - 1].h.v < t->h.v) {
+            new(&elem[n]) T();
+            elem[n] = *t;
+            n++;
+            if(index && 2*n <= (1 << indexBits)) {
+                IndexInsert(n - 1);
+            } else {
+                Reindex();
+            }
+            return;
+        }
+
         int first = 0, last = n;
         // We know that we must insert within the closed interval [first,last]
         while(first != last) {
@@ -327,6 +384,29 @@ public:
         std::move_backward(elem + i, elem + n, elem + n + 1);
         elem[i] = *t;
         n++;
+        Reindex();
+    }
+
+    // To load many elements at once, without keeping the list sorted as we
+    // go: add them with AddUnsorted(), in any order, and then call Sort()
+    // before doing anything else with the list.
+    void AddUnsorted(T *t) {
+        if(n >= elemsAllocated) {
+            ReserveMore((elemsAllocated + 32)*2 - n);
+        }
+        new(&elem[n]) T();
+        elem[n] = *t;
+        n++;
+    }
+
+    void Sort() {
+        std::sort(elem, elem + n, [](const T &a, const T &b) {
+            return a.h.v < b.h.v;
+        });
+        for(int i = 1; i < n; i++) {
+            ssassert(elem[i - 1].h.v != elem[i].h.v, "Handle isn't unique");
+        }
+        Reindex();
     }
 
     T *FindById(H h) {
@@ -336,6 +416,14 @@ public:
     }
 
     int IndexOf(H h) {
+        if(index) {
+            int mask = (1 << indexBits) - 1;
+            for(int s = IndexSlot(h.v);; s = (s + 1) & mask) {
+                int i = index[s];
+                if(i < 0 || elem[i].h.v == h.v) return i;
+            }
+        }
+
         int first = 0, last = n-1;
         while(first <= last) {
             int mid = (first + last)/2;
@@ -352,19 +440,8 @@ public:
     }
 
     T *FindByIdNoOops(H h) {
-        int first = 0, last = n-1;
-        while(first <= last) {
-            int mid = (first + last)/2;
-            H hm = elem[mid].h;
-            if(hm.v > h.v) {
-                last = mid-1; // and first stays the same
-            } else if(hm.v < h.v) {
-                first = mid+1; // and last stays the same
-            } else {
-                return &(elem[mid]);
-            }
-        }
-        return NULL;
+        int i = IndexOf(h);
+        return (i >= 0) ? &(elem[i]) : NULL;
     }
 
     T *First() {
@@ -415,6 +492,7 @@ public:
             elem[i].~T();
         n = dest;
         // and elemsAllocated is untouched, because we didn't resize
+        Reindex();
     }
     void RemoveById(H h) {
         ClearTags();
@@ -427,6 +505,7 @@ public:
         *l = *this;
         elemsAllocated = n = 0;
         elem = NULL;
+        index = NULL;
     }
 
     void DeepCopyInto(IdList<T,H> *l) {
@@ -436,6 +515,7 @@ public:
             new(&l->elem[i]) T(elem[i]);
         l->elemsAllocated = elemsAllocated;
         l->n = n;
+        l->Reindex();
     }
 
     void Clear() {
@@ -446,6 +526,8 @@ public:
         elemsAllocated = n = 0;
         if(elem) MemFree(elem);
         elem = NULL;
+        if(index) MemFree(index);
+        index = NULL;
     }
 
 };
@@ -357,6 +357,263 @@ double Expr::Eval() const {
     ssassert(false, "Unexpected operation");
 }
 
+//-----------------------------------------------------------------------------
+// Compiling expressions to a tape, and evaluating the tape.
+//-----------------------------------------------------------------------------
+void ExprTape::Clear() {
+    code.clear();
+    constant.clear();
+    slotParam.clear();
+    output.clear();
+    start.clear();
+    usedStart.clear();
+    used.clear();
+    loads.clear();
+    paramReg.clear();
+    constantReg.clear();
+    instrReg.clear();
+}
+
+int ExprTape::Emit(Expr::Op op, int a, int b) {
+    Instr in = { op, a, b };
+    code.push_back(in);
+    return (int)code.size() - 1;
+}
+
+// Emit an instruction, unless the same one is already in this expression,
+// in which case use that one's register.
+int ExprTape::EmitShared(Expr::Op op, int a, int b) {
+    // These are commutative, and the order doesn't change the rounding.
+    if((op == Expr::Op::PLUS || op == Expr::Op::TIMES) && a > b) swap(a, b);
+
+    Instr in = { op, a, b };
+    auto it = instrReg.find(in);
+    if(it != instrReg.end()) return it->second;
+    int r = Emit(op, a, b);
+    instrReg[in] = r;
+    return r;
+}
+
+int ExprTape::Compile(const Expr *e) {
+    int r;
+    switch(e->op) {
+        case Expr::Op::PARAM_PTR: {
+            auto pit = paramReg.find(e->parp);
+            if(pit != paramReg.end()) {
+                r = pit->second;
+            } else {
+                slotParam.push_back(e->parp);
+                r = Emit(e->op, (int)slotParam.size() - 1, 0);
+                paramReg[e->parp] = r;
+                loads.push_back(r);
+            }
+            used.push_back(r);
+            break;
+        }
+
+        case Expr::Op::CONSTANT: {
+            // By the bits, so that 0 and -0 stay different.
+            uint64_t bits;
+            memcpy(&bits, &(e->v), sizeof(bits));
+            auto cit = constantReg.find(bits);
+            if(cit != constantReg.end()) {
+                r = cit->second;
+            } else {
+                constant.push_back(e->v);
+                r = Emit(e->op, (int)constant.size() - 1, 0);
+                constantReg[bits] = r;
+            }
+            break;
+        }
+
+        case Expr::Op::PARAM:
+            ssassert(false, "Params must be resolved to pointers before compiling");
+
+        case Expr::Op::VARIABLE:
+            ssassert(false, "Not supported yet");
+
+        case Expr::Op::PLUS:
+        case Expr::Op::MINUS:
+        case Expr::Op::TIMES:
+        case Expr::Op::DIV: {
+            int a = Compile(e->a);
+            int b = Compile(e->b);
+            r = EmitShared(e->op, a, b);
+            break;
+        }
+
+        case Expr::Op::NEGATE:
+        case Expr::Op::SQRT:
+        case Expr::Op::SQUARE:
+        case Expr::Op::SIN:
+        case Expr::Op::COS:
+        case Expr::Op::ASIN:
+        case Expr::Op::ACOS:
+            r = EmitShared(e->op, Compile(e->a), 0);
+            break;
+
+        default: ssassert(false, "Unexpected operation");
+    }
+    return r;
+}
+
+// Compile an expression, and return the index at which Eval() will write its
+// value.
+int ExprTape::Add(const Expr *e) {
+    if(usedStart.empty()) usedStart.push_back(0);
+    // An expression can share only the param loads with the ones before,
+    // so that it's still all that Partials() and EvalRange() need.
+    constantReg.clear();
+    instrReg.clear();
+    start.push_back((int)code.size());
+    int r = Compile(e);
+    if(code[r].op == Expr::Op::PARAM_PTR) {
+        // The expression folded down to a bare param, whose load may come
+        // from an earlier expression; multiply it by one, so that the output
+        // is still an instruction of this expression, after its start.
+        constant.push_back(1.0);
+        int one = Emit(Expr::Op::CONSTANT, (int)constant.size() - 1, 0);
+        r = Emit(Expr::Op::TIMES, r, one);
+    }
+    output.push_back(r);
+
+    auto first = used.begin() + usedStart.back();
+    std::sort(first, used.end());
+    used.erase(std::unique(first, used.end()), used.end());
+    usedStart.push_back((int)used.size());
+    return (int)output.size() - 1;
+}
+
+// Run the instructions from first up to last, which load params only if
+// andLoads is set.
+static void Execute(const ExprTape::Instr *in, size_t first, size_t last,
+                    bool andLoads, const std::vector<Param *> &slotParam,
+                    const std::vector<double> &constant, double *r)
+{
+    size_t i;
+    for(i = first; i < last; i++) {
+        int a = in[i].a, b = in[i].b;
+        switch(in[i].op) {
+            case Expr::Op::PARAM_PTR:
+                if(andLoads) r[i] = slotParam[a]->val;
+                break;
+            case Expr::Op::CONSTANT:    r[i] = constant[a]; break;
+
+            case Expr::Op::PLUS:        r[i] = r[a] + r[b]; break;
+            case Expr::Op::MINUS:       r[i] = r[a] - r[b]; break;
+            case Expr::Op::TIMES:       r[i] = r[a] * r[b]; break;
+            case Expr::Op::DIV:         r[i] = r[a] / r[b]; break;
+
+            case Expr::Op::NEGATE:      r[i] = -r[a]; break;
+            case Expr::Op::SQRT:        r[i] = sqrt(r[a]); break;
+            case Expr::Op::SQUARE:      r[i] = r[a]*r[a]; break;
+            case Expr::Op::SIN:         r[i] = sin(r[a]); break;
+            case Expr::Op::COS:         r[i] = cos(r[a]); break;
+            case Expr::Op::ACOS:        r[i] = acos(r[a]); break;
+            case Expr::Op::ASIN:        r[i] = asin(r[a]); break;
+
+            default: ssassert(false, "Unexpected operation");
+        }
+    }
+}
+
+void ExprTape::Eval(double *out) {
+    reg.resize(code.size());
+    adj.resize(code.size());
+    Execute(code.data(), 0, code.size(), /*andLoads=*/true, slotParam,
+            constant, reg.data());
+    for(size_t i = 0; i < output.size(); i++) {
+        out[i] = reg[output[i]];
+    }
+}
+
+//-----------------------------------------------------------------------------
+// The same as Eval(), but in pieces that can run at the same time on
+// different threads: first LoadParams(), and then EvalRange() for each
+// range of expressions. An expression refers to earlier instructions only
+// to load a param, so once those are loaded, each range needs nothing from
+// the others; and each expression gets worked out just as in Eval().
+//-----------------------------------------------------------------------------
+void ExprTape::LoadParams() {
+    reg.resize(code.size());
+    adj.resize(code.size());
+    for(int i : loads) {
+        reg[i] = slotParam[code[i].a]->val;
+    }
+}
+
+void ExprTape::EvalRange(int first, int last, double *out) {
+    if(first >= last) return;
+    // Up to where the next expression starts, and not just to the last
+    // output, so that the range is right whatever register that is.
+    size_t end = (last < (int)start.size()) ? start[last] : code.size();
+    Execute(code.data(), start[first], end,
+            /*andLoads=*/false, slotParam, constant, reg.data());
+    for(int i = first; i < last; i++) {
+        out[i] = reg[output[i]];
+    }
+}
+
+// The partials of expression i with respect to the params in registers wrt,
+// at the point where we last called Eval(). Each expression's instructions
+// are contiguous, and they can refer to earlier instructions only to load
+// a param, so the sweep touches just those and the param registers. The
+// adjoints of those go straight to out, since other expressions share the
+// registers, and may be working on them at the same time.
+void ExprTape::Partials(int i, const int *wrt, int count, double *out) {
+    const double *r = reg.data();
+    const Instr *in = code.data();
+    double *d = adj.data();
+    int k, first = start[i], last = output[i];
+
+    for(k = first; k <= last; k++) d[k] = 0;
+    for(k = 0; k < count; k++) out[k] = 0;
+    d[last] = 1;
+
+    // Add v to the adjoint of register x.
+    auto add = [&](int x, double v) {
+        if(in[x].op != Expr::Op::PARAM_PTR) {
+            d[x] += v;
+            return;
+        }
+        for(int j = 0; j < count; j++) {
+            if(wrt[j] == x) {
+                out[j] += v;
+                break;
+            }
+        }
+    };
+
+    for(k = last; k >= first; k--) {
+        double g = d[k];
+        if(EXACT(g == 0)) continue;
+        int a = in[k].a, b = in[k].b;
+        switch(in[k].op) {
+            case Expr::Op::PARAM_PTR:
+            case Expr::Op::CONSTANT:
+                break;
+
+            case Expr::Op::PLUS:    add(a, g); add(b, g); break;
+            case Expr::Op::MINUS:   add(a, g); add(b, -g); break;
+            case Expr::Op::TIMES:   add(a, g*r[b]); add(b, g*r[a]); break;
+            case Expr::Op::DIV:
+                add(a, g/r[b]);
+                add(b, -(g*r[a]/(r[b]*r[b])));
+                break;
+
+            case Expr::Op::NEGATE:  add(a, -g); break;
+            case Expr::Op::SQRT:    add(a, g*0.5/r[k]); break;
+            case Expr::Op::SQUARE:  add(a, g*2*r[a]); break;
+            case Expr::Op::SIN:     add(a, g*cos(r[a])); break;
+            case Expr::Op::COS:     add(a, -(g*sin(r[a]))); break;
+            case Expr::Op::ASIN:    add(a, g/sqrt(1 - r[a]*r[a])); break;
+            case Expr::Op::ACOS:    add(a, -(g/sqrt(1 - r[a]*r[a]))); break;
+
+            default: ssassert(false, "Unexpected operation");
+        }
+    }
+}
+
 Expr *Expr::PartialWrt(hParam p) const {
     Expr *da, *db;
 
@@ -491,15 +748,19 @@ Expr *Expr::FoldConstants() {
     return n;
 }
 
-void Expr::Substitute(hParam oldh, hParam newh) {
+// Replace each param that's been substituted with the one that replaced it.
+void Expr::Substitute(IdList<Param,hParam> *pl) {
     ssassert(op != Op::PARAM_PTR, "Expected an expression that refer to params via handles");
 
-    if(op == Op::PARAM && parh.v == oldh.v) {
-        parh = newh;
+    if(op == Op::PARAM) {
+        Param *p = pl->FindByIdNoOops(parh);
+        if(p && p->tag == System::VAR_SUBSTITUTED) {
+            parh = p->substd;
+        }
     }
     int c = Children();
-    if(c >= 1) a->Substitute(oldh, newh);
-    if(c >= 2) b->Substitute(oldh, newh);
+    if(c >= 1) a->Substitute(pl);
+    if(c >= 2) b->Substitute(pl);
 }
 
 //-----------------------------------------------------------------------------
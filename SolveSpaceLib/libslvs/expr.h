@@ -74,7 +74,7 @@ public:
     bool DependsOn(hParam p) const;
     static bool Tol(double a, double b);
     Expr *FoldConstants();
-    void Substitute(hParam oldh, hParam newh);
+    void Substitute(IdList<Param,hParam> *pl);
 
     static const hParam NO_PARAMS, MULTIPLE_PARAMS;
     hParam ReferencedParams(ParamList *pl) const;
@@ -100,6 +100,69 @@ public:
     static Expr *From(const char *in, bool popUpError);
 };
 
+// A set of expressions compiled to a flat program, so that we can evaluate
+// them over and over (once per Newton iteration) without chasing pointers
+// around the temporary heap. Each instruction is an operation from the
+// expression, and it writes its result to the register with the same index
+// as the instruction; the operands are registers written earlier. The
+// params are referred to by slot, which holds the pointer to the param.
+//
+// The tape also gives us the partials of each expression by reverse mode
+// differentiation: one backwards sweep over that expression's instructions,
+// after an Eval(), gets its partials with respect to every param at once.
+class ExprTape {
+public:
+    struct Instr {
+        Expr::Op    op;
+        // The operand registers, or the index of the slot or constant
+        int         a, b;
+
+        bool operator==(const Instr &o) const {
+            return op == o.op && a == o.a && b == o.b;
+        }
+    };
+    struct InstrHash {
+        size_t operator()(const Instr &in) const {
+            return std::hash<uint64_t>()(((uint64_t)in.a << 32) ^ (uint32_t)in.b) ^
+                   ((size_t)in.op << 1);
+        }
+    };
+
+    std::vector<Instr>      code;
+    std::vector<double>     constant;
+    std::vector<Param *>    slotParam;
+    // The register that holds the value of each compiled expression, and
+    // the first instruction that was compiled for it
+    std::vector<int>        output;
+    std::vector<int>        start;
+    // The registers of the params that each expression refers to, sorted
+    std::vector<int>        usedStart;
+    std::vector<int>        used;
+    // The instructions that load params
+    std::vector<int>        loads;
+    std::vector<double>     reg;
+    std::vector<double>     adj;
+
+    // Only needed while we're compiling, so that each param gets loaded
+    // just once; and, within each expression, so that each constant and
+    // each operation on the same operands gets computed just once, since
+    // the equations are full of repeated subexpressions (like the basis
+    // vectors of a workplane, or the direction of a line).
+    std::unordered_map<Param *, int>        paramReg;
+    std::unordered_map<uint64_t, int>       constantReg;
+    std::unordered_map<Instr, int, InstrHash> instrReg;
+
+    void Clear();
+    int Add(const Expr *e);
+    int Emit(Expr::Op op, int a, int b);
+    int EmitShared(Expr::Op op, int a, int b);
+    int Compile(const Expr *e);
+    void Eval(double *out);
+    void LoadParams();
+    void EvalRange(int first, int last, double *out);
+    void Partials(int i, const int *wrt, int count, double *out);
+};
+
 class ExprVector {
 public:
     Expr *x, *y, *z;
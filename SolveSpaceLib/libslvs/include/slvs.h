@@ -193,12 +193,178 @@ typedef struct {
 #define SLVS_RESULT_OKAY                0
 #define SLVS_RESULT_INCONSISTENT        1
 #define SLVS_RESULT_DIDNT_CONVERGE      2
+/* No longer returned; the solver's matrices grow with the system. Kept
+ * so that existing callers still compile. */
 #define SLVS_RESULT_TOO_MANY_UNKNOWNS   3
     int                 result;
 } Slvs_System;
 
 DLL void Slvs_Solve(Slvs_System *sys, Slvs_hGroup hg);
 
+/* Where the time went in the most recent call to Slvs_Solve(). The sizes
+ * are those of the Jacobian left after substitution, and the times are
+ * in seconds. setupTime covers copying the caller's params, entities and
+ * constraints into the solver; generateTime covers writing the equations,
+ * and substituteTime solving the trivial ones by substitution. */
+typedef struct {
+    int                 unknowns;
+    int                 equations;
+    int                 nonzeros;
+    int                 iterations;
+
+    double              setupTime;
+    double              generateTime;
+    double              substituteTime;
+    double              jacobianTime;
+    double              evalTime;
+    double              solveTime;
+    double              rankTime;
+    double              totalTime;
+} Slvs_SolveStats;
+
+DLL void Slvs_GetLastSolveStats(Slvs_SolveStats *stats);
+
+/* Solve the same system for many values of some of its dimensions, as for
+ * a design table. varied[] lists the varieds constraints whose valA
+ * changes (a distance, an angle, a diameter, and so on), and there are
+ * variants sets of values for them, one after another in values[], so
+ * that values[v*varieds + k] is the valA of constraint varied[k] in
+ * variant v. The valA in sys->constraint is only used for the constraints
+ * that aren't in varied[].
+ *
+ * Each variant starts from the values in sys->param, and gets the solved
+ * values of all of the params in params[v*sys->params + i], in the same
+ * order as sys->param[], and its result (as in sys->result) in
+ * results[v]. sys isn't changed, and no failed constraints are reported.
+ *
+ * The variants are spread over a pool of threads, one for each core. Each
+ * thread writes the equations once, with the varied dimensions read from
+ * params instead of written in as numbers, and then solves them again for
+ * each variant that it takes; so it's like solving again in a context. The
+ * solver settings are the ones for Slvs_Solve(). Each variant gets the same
+ * result whichever thread solves it. That's also the result of
+ * Slvs_Solve() with those values, except that an angle near zero scales
+ * its equation by the angle in sys->constraint, which can change which
+ * systems the rank test calls inconsistent. */
+DLL void Slvs_SolveBatch(const Slvs_System *sys, Slvs_hGroup hg,
+                         const Slvs_hConstraint *varied, int varieds,
+                         const double *values, int variants,
+                         double *params, int *results);
+
+/* What the structure of the system says about it, from which params each
+ * equation refers to, without evaluating anything or running Newton's
+ * method; so it's cheap enough to redo after every edit. The equations are
+ * paired up, as many as possible, each with a param of its own (a maximum
+ * matching). A param left over is a degree of freedom, and an equation
+ * left over is redundant. The over-constrained part is the equations that
+ * some of those left over equations compete with for params, and their
+ * params; the under-constrained part is the same for the params left
+ * over; and the rest is well-constrained (the Dulmage-Mendelsohn
+ * decomposition).
+ *
+ * This is exact for generic values of the params. Particular values can
+ * make more equations dependent (two lines that are both horizontal and
+ * parallel, say), which only a solve finds; so a solve reports at least
+ * this many degrees of freedom, and it finds any redundancy found here.
+ *
+ * Slvs_AnalyzeStructure() sets sys->dof to that many degrees of freedom,
+ * and sys->result to SLVS_RESULT_INCONSISTENT if there's an over-
+ * constrained part, or SLVS_RESULT_OKAY if not. If sys->failed isn't NULL,
+ * then it also reports the constraints in the over-constrained part,
+ * like a solve does. It doesn't change the params. If st isn't NULL, it
+ * gets the rest. */
+typedef struct {
+    int                 unknowns;
+    int                 equations;
+    int                 dof;
+    int                 redundant;
+
+    int                 overUnknowns;
+    int                 overEquations;
+    int                 underUnknowns;
+    int                 underEquations;
+} Slvs_Structure;
+
+DLL void Slvs_AnalyzeStructure(Slvs_System *sys, Slvs_hGroup hg,
+                               Slvs_Structure *st);
+
+/* How the solver factors its linear systems. The sparse backend is always
+ * there. The dense one uses LAPACK, and exists only if the library was
+ * built with it; AUTO (the default) uses it for mid-sized systems whose
+ * factor would be mostly full anyway. Returns 1 if the backend is
+ * available, or 0 (leaving the choice unchanged) if it is not. */
+#define SLVS_SOLVER_AUTO                0
+#define SLVS_SOLVER_SPARSE              1
+#define SLVS_SOLVER_DENSE               2
+
+DLL int Slvs_SetLinearSolver(int solver);
+
+/* How the solver steps towards a solution. NEWTON (the default) takes full
+ * Newton steps, which is fastest from a good starting point. LEVENBERG_-
+ * MARQUARDT damps each step, more so the worse the last one did, so it's
+ * slower but converges from much further away, as after a big drag.
+ * Returns 1 if the method is known, or 0 (leaving the choice unchanged) if
+ * it is not. */
+#define SLVS_METHOD_NEWTON              0
+#define SLVS_METHOD_LEVENBERG_MARQUARDT 1
+
+DLL int Slvs_SetSolverMethod(int method);
+
+/* A system with at least this many equations left after substitution gets
+ * them and their Jacobian evaluated on a pool of threads (one for each
+ * core), a chunk of equations at a time, in each Newton iteration. Each
+ * equation is worked out the same way by whichever thread gets it, so the
+ * results don't change. Zero means the default, 4096; a negative number
+ * means never. */
+DLL void Slvs_SetParallelThreshold(int equations);
+
+/* The functions above all share a single solver, so only one solve can
+ * run at a time. A context has a solver of its own (its own copy of the
+ * sketch, its own system of equations, and its own heap for temporaries),
+ * so solves in different contexts can run at the same time, on different
+ * threads. Each context must be used by only one thread at a time. The
+ * functions that take a context otherwise behave like the ones above.
+ *
+ * A context also keeps the equations that it wrote for its last solve. If
+ * the next system that it's asked to solve is the same but for the values
+ * of the params in the group being solved (as from one frame of a drag to
+ * the next), then it reuses those equations, and their Jacobian and its
+ * factorization, and goes straight to Newton's method. Anything else (any
+ * change to the entities, constraints, or dragged params, or to the values
+ * of params in other groups, or of those of a point held where dragged or
+ * of normals in the same orientation) makes it start over. Either way, the
+ * result is the same as from Slvs_Solve(). Analyzing a system in a context
+ * keeps what it wrote in the same way, so solving the same system next
+ * doesn't write it again, and analyzing it again (after a solve or not)
+ * costs only the comparison. */
+typedef struct Slvs_Context Slvs_Context;
+
+DLL Slvs_Context *Slvs_CreateContext(void);
+DLL void Slvs_DestroyContext(Slvs_Context *ctx);
+
+DLL void Slvs_SolveInContext(Slvs_Context *ctx, Slvs_System *sys,
+                             Slvs_hGroup hg);
+DLL void Slvs_AnalyzeStructureInContext(Slvs_Context *ctx, Slvs_System *sys,
+                                        Slvs_hGroup hg, Slvs_Structure *st);
+DLL void Slvs_GetContextSolveStats(Slvs_Context *ctx, Slvs_SolveStats *stats);
+DLL int Slvs_SetContextLinearSolver(Slvs_Context *ctx, int solver);
+DLL int Slvs_SetContextSolverMethod(Slvs_Context *ctx, int method);
+DLL void Slvs_SetContextParallelThreshold(Slvs_Context *ctx, int equations);
+
+/* With the predictor on, a context that solves the same system again (as
+ * in a drag) doesn't start Newton's method right from the values that the
+ * caller gave it. It extrapolates the params that the caller left where
+ * the context put them last time from its last two solves, scaled by how
+ * far the params that the caller did move (the dragged point) went in the
+ * same direction; and then takes a first step with the Jacobian from the
+ * last solve, which is cheaper than a Newton iteration. So it needs fewer
+ * iterations (see Slvs_GetContextSolveStats()); if it doesn't converge,
+ * it solves again from the caller's values. Where the sketch has degrees
+ * of freedom left, the answer can differ a little from the one without the
+ * predictor, though it satisfies the same constraints. This does nothing
+ * for the params in Slvs_System.dragged[]. It's off by default. */
+DLL void Slvs_SetContextPredictor(Slvs_Context *ctx, int predict);
+
 
 /* Our base coordinate system has basis vectors
  *     (1, 0, 0)  (0, 1, 0)  (0, 0, 1)
@@ -0,0 +1,175 @@
+//-----------------------------------------------------------------------------
+// A dense backend for the least squares solve and the rank test, using
+// BLAS and LAPACK. For a mid-sized system whose factor would fill in most
+// of the way anyway, these blocked, vectorized (and, with OpenBLAS,
+// multithreaded) kernels beat the sparse code. This is only built if
+// SLVS_WITH_LAPACK is on.
+//-----------------------------------------------------------------------------
+#include "solvespace.h"
+
+#if defined(HAVE_LAPACK)
+#include <lapacke.h>
+
+extern "C" {
+// BLAS doesn't come with a header of its own, so declare the one routine
+// that we need the same way that lapacke.h declares the LAPACK ones.
+void LAPACK_GLOBAL(dsyrk,DSYRK)(char *uplo, char *trans, lapack_int *n,
+                                lapack_int *k, double *alpha, double *a,
+                                lapack_int *lda, double *beta, double *c,
+                                lapack_int *ldc);
+}
+
+const bool System::HAVE_DENSE_BACKEND = true;
+
+bool System::UseDenseBackend() {
+    switch(backend) {
+        case Backend::SPARSE: return false;
+        case Backend::DENSE:  return mat.m > 0;
+        case Backend::AUTO:   break;
+    }
+
+    // Small systems are cheap either way, and big ones don't fit densely.
+    if(mat.m < 100 || mat.m > 2000) return false;
+
+    // Otherwise it's worth it if the factor is mostly full; the symbolic
+    // analysis is cached, so this doesn't cost anything extra.
+    mat.factor.Analyze(mat.A);
+    double lowerTriangle = 0.5*mat.m*(mat.m - 1);
+    return mat.factor.lStart[mat.m] > 0.3*lowerTriangle;
+}
+
+//-----------------------------------------------------------------------------
+// The rank of A, as the rank of A' from a QR with column pivoting; |R[k][k]|
+// is the magnitude of what's left of the k-th row of A after we subtract
+// off its components in the directions of the rows before, so we use the
+// same tolerance as the Gram-Schmidt.
+//-----------------------------------------------------------------------------
+int System::CalculateRankDense() {
+    lapack_int m = mat.m, n = mat.n;
+    if(m == 0 || n == 0) return 0;
+
+    // A' is n by m, stored by columns, so row i of A is column i of A'.
+    std::vector<double> At((size_t)n*m, 0.0);
+    int i, k;
+    for(i = 0; i < m; i++) {
+        for(k = mat.A.rowStart[i]; k < mat.A.rowStart[i + 1]; k++) {
+            At[(size_t)i*n + mat.A.col[k]] = mat.A.num[k];
+        }
+    }
+
+    std::vector<lapack_int> jpvt(m, 0);
+    std::vector<double> tau(std::min(m, n));
+    lapack_int lwork = -1, info;
+    double workSize;
+    LAPACK_dgeqp3(&n, &m, At.data(), &n, jpvt.data(), tau.data(),
+                  &workSize, &lwork, &info);
+    lwork = (lapack_int)workSize;
+    std::vector<double> work(lwork);
+    LAPACK_dgeqp3(&n, &m, At.data(), &n, jpvt.data(), tau.data(),
+                  work.data(), &lwork, &info);
+    ssassert(info == 0, "Unexpected failure in dgeqp3");
+
+    int rank = 0;
+    for(k = 0; k < std::min(m, n); k++) {
+        if(ffabs(At[(size_t)k*n + k]) > RANK_MAG_TOLERANCE) rank++;
+    }
+    return rank;
+}
+
+//-----------------------------------------------------------------------------
+// Solve for the least squares step, like the sparse code does: a Cholesky
+// of A*A' from dsyrk, or, if that's too badly conditioned to trust, the
+// minimum norm solution straight from a QR of A. Writes the (unscaled)
+// step in to mat.X. We can't handle a rank-deficient A, so in that case we
+// return false and leave it to the sparse code, which drops the dependent
+// rows. A nonzero damping gets added to the diagonal of A*A', which makes
+// it well-conditioned enough that we never need the QR.
+//-----------------------------------------------------------------------------
+bool System::SolveLeastSquaresDense(double damping) {
+    lapack_int m = mat.m, n = mat.n, one = 1, info;
+    int i, j, k;
+    if(m > n) return false;
+
+    // A is m by n, stored by columns.
+    std::vector<double> Ad((size_t)m*n, 0.0);
+    for(i = 0; i < m; i++) {
+        for(k = mat.A.rowStart[i]; k < mat.A.rowStart[i + 1]; k++) {
+            Ad[(size_t)mat.A.col[k]*m + i] = mat.A.num[k];
+        }
+    }
+
+    std::vector<double> AAt((size_t)m*m);
+    double alpha = 1, beta = 0;
+    char lower = 'L', noTrans = 'N';
+    LAPACK_GLOBAL(dsyrk,DSYRK)(&lower, &noTrans, &m, &n, &alpha, Ad.data(), &m,
+                               &beta, AAt.data(), &m);
+
+    std::vector<double> diag(m);
+    for(i = 0; i < m; i++) {
+        AAt[(size_t)i*m + i] += damping;
+        diag[i] = AAt[(size_t)i*m + i];
+    }
+
+    mat.Z.assign(mat.B.num.begin(), mat.B.num.end());
+    LAPACK_dposv(&lower, &m, &one, AAt.data(), &m, mat.Z.data(), &m, &info);
+    if(info != 0) return false;
+
+    // The diagonal of the Cholesky factor squared is the LDL' pivot.
+    double worstPivot = VERY_POSITIVE;
+    for(i = 0; i < m; i++) {
+        double l = AAt[(size_t)i*m + i];
+        worstPivot = std::min(worstPivot, l*l/diag[i]);
+    }
+
+    // A row that's dependent on the ones before it makes A*A' singular,
+    // even if rounding let the Cholesky through.
+    if(worstPivot <= PIVOT_TOLERANCE) return false;
+
+    if(worstPivot >= ILL_CONDITIONED || damping > 0) {
+        for(j = 0; j < n; j++) {
+            double sum = 0;
+            for(k = mat.A.colStart[j]; k < mat.A.colStart[j + 1]; k++) {
+                sum += mat.A.num[mat.A.colEntry[k]]*mat.Z[mat.A.row[k]];
+            }
+            mat.X[j] = sum;
+        }
+        return true;
+    }
+
+    // The right hand side goes in and the solution comes out of the same
+    // array, which must be big enough for either.
+    std::vector<double> bx(n, 0.0);
+    std::copy(mat.B.num.begin(), mat.B.num.end(), bx.begin());
+    lapack_int lwork = -1;
+    double workSize;
+    LAPACK_dgels(&noTrans, &m, &n, &one, Ad.data(), &m, bx.data(), &n,
+                 &workSize, &lwork, &info);
+    lwork = (lapack_int)workSize;
+    std::vector<double> work(lwork);
+    LAPACK_dgels(&noTrans, &m, &n, &one, Ad.data(), &m, bx.data(), &n,
+                 work.data(), &lwork, &info);
+    if(info != 0) return false;
+
+    for(j = 0; j < n; j++) {
+        mat.X[j] = bx[j];
+    }
+    return true;
+}
+
+#else
+
+const bool System::HAVE_DENSE_BACKEND = false;
+
+bool System::UseDenseBackend() {
+    return false;
+}
+
+int System::CalculateRankDense() {
+    ssassert(false, "Built without LAPACK");
+}
+
+bool System::SolveLeastSquaresDense(double) {
+    ssassert(false, "Built without LAPACK");
+}
+
+#endif
@@ -8,10 +8,66 @@
 #define EXPORT_DLL
 #include <slvs.h>
 
-Sketch SolveSpace::SK = {};
-static System SYS;
-
-static int IsInit = 0;
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+
+// Everything about a system that decides which equations we write for it,
+// so that we can tell when the next system is the same as the last one:
+// all of it but the values of the params, except for those values that end
+// up as numbers in the equations.
+struct SessionKey {
+    std::vector<uint32_t>   words;
+    std::vector<double>     values;
+
+    bool operator==(const SessionKey &other) const {
+        return words == other.words && values == other.values;
+    }
+};
+
+// Everything that a solve needs. Solves in different contexts share no
+// state, so they can run at the same time on different threads.
+struct Slvs_Context {
+    Sketch              sketch;
+    System              sys;
+    TemporaryHeap       heap;
+    Slvs_SolveStats     lastStats;
+
+    // Whether we keep the equations that we wrote after the solve, so that
+    // we can solve them again if the next system has the same key.
+    bool                keepSession;
+    SessionKey          sessionKey;
+
+    // Whether the sketch and the system hold what WriteSketch() made from
+    // the system with that key, and haven't been solved yet; and whether
+    // we've analyzed its structure, and what that found. The structure
+    // doesn't depend on the values, so that holds until the key changes.
+    bool                written;
+    bool                analyzed;
+    Slvs_Structure      structure;
+    std::vector<Slvs_hConstraint> structureFailed;
+
+    // Whether we guess where the next solve in the session will end up,
+    // from the last two that converged; and the values of the caller's
+    // params that went in to and came out of those, in the caller's order.
+    bool                predict;
+    int                 frames;
+    std::vector<double> lastIn, prevIn;
+    std::vector<double> lastOut, prevOut;
+
+    // The constraints whose dimensions a batch solve varies. Each of those
+    // reads its valA from a param of its own in the sketch, so a new value
+    // doesn't mean writing the equations again; and this is the value that
+    // each gets in the next solve.
+    std::vector<Slvs_hConstraint> varied;
+    std::vector<hParam>           variedParam;
+    std::vector<double>           variedValue;
+};
+
+// The context for the original API, that has no context argument.
+static Slvs_Context DefaultContext = {};
+
+thread_local Sketch *SolveSpace::ActiveSketch = NULL;
 
 void Group::GenerateEquations(IdList<Equation,hEquation> *) {
     // Nothing to do for now.
@@ -78,26 +134,122 @@ void Slvs_MakeQuaternion(double ux, double uy, double uz,
     *qz = q.vz;
 }
 
-void Slvs_Solve(Slvs_System *ssys, Slvs_hGroup shg)
+static void WriteSessionKey(const Slvs_System *ssys, Slvs_hGroup shg,
+                            SessionKey *key)
 {
-    if(!IsInit) {
-        InitPlatform(0, NULL);
-        IsInit = 1;
+    int i, j;
+    key->words.clear();
+    key->values.clear();
+
+    key->words.push_back(shg);
+    key->words.push_back(ssys->calculateFaileds ? 1 : 0);
+    for(i = 0; i < (int)arraylen(ssys->dragged); i++) {
+        key->words.push_back(ssys->dragged[i]);
+    }
+
+    // A point held where it's dragged is held at its current position, and
+    // two normals in the same orientation pick their equations by how they
+    // are now; so those params go in by value.
+    std::unordered_set<Slvs_hParam> baked;
+    std::unordered_map<Slvs_hEntity, const Slvs_Entity *> entityById;
+    for(i = 0; i < ssys->constraints; i++) {
+        const Slvs_Constraint *sc = &(ssys->constraint[i]);
+        Slvs_hEntity he[2] = { 0, 0 };
+        if(sc->type == SLVS_C_WHERE_DRAGGED) {
+            he[0] = sc->ptA;
+        } else if(sc->type == SLVS_C_SAME_ORIENTATION) {
+            he[0] = sc->entityA;
+            he[1] = sc->entityB;
+        } else {
+            continue;
+        }
+
+        if(entityById.empty()) {
+            for(j = 0; j < ssys->entities; j++) {
+                entityById[ssys->entity[j].h] = &(ssys->entity[j]);
+            }
+        }
+        for(Slvs_hEntity h : he) {
+            auto it = entityById.find(h);
+            if(it == entityById.end()) continue;
+            for(Slvs_hParam hp : it->second->param) {
+                if(hp) baked.insert(hp);
+            }
+        }
+    }
+
+    // And so do the params of the other groups, since we use them as
+    // numbers too.
+    for(i = 0; i < ssys->params; i++) {
+        const Slvs_Param *sp = &(ssys->param[i]);
+        key->words.push_back(sp->h);
+        key->words.push_back(sp->group);
+        if(sp->group != shg || baked.count(sp->h)) {
+            key->values.push_back(sp->val);
+        }
+    }
+
+    for(i = 0; i < ssys->entities; i++) {
+        const Slvs_Entity *se = &(ssys->entity[i]);
+        key->words.insert(key->words.end(), {
+            se->h, se->group, (uint32_t)se->type, se->wrkpl,
+            se->point[0], se->point[1], se->point[2], se->point[3],
+            se->normal, se->distance,
+            se->param[0], se->param[1], se->param[2], se->param[3] });
+    }
+
+    for(i = 0; i < ssys->constraints; i++) {
+        const Slvs_Constraint *sc = &(ssys->constraint[i]);
+        key->words.insert(key->words.end(), {
+            sc->h, sc->group, (uint32_t)sc->type, sc->wrkpl,
+            sc->ptA, sc->ptB, sc->entityA, sc->entityB,
+            sc->entityC, sc->entityD,
+            (uint32_t)(sc->other ? 1 : 0), (uint32_t)(sc->other2 ? 1 : 0) });
+        key->values.push_back(sc->valA);
     }
+}
+
+// Forget the equations from the last solve, and everything that we wrote
+// them from. This must be called with the context's heap active.
+static void ClearSession(Slvs_Context *ctx)
+{
+    ctx->sys.Clear();
+    ctx->frames   = 0;
+    ctx->written  = false;
+    ctx->analyzed = false;
 
+    ctx->sketch.param.Clear();
+    ctx->sketch.entity.Clear();
+    ctx->sketch.constraint.Clear();
+
+    FreeAllTemporary();
+}
+
+// Copy the caller's system in to the sketch and the system to solve.
+// Returns false if it has something in it that we don't know about.
+static bool WriteSketch(Slvs_Context *ctx, Slvs_System *ssys, Slvs_hGroup shg)
+{
+    System &SYS = ctx->sys;
+
+    // The caller's handles can come in any order, so we load each list
+    // unsorted and then sort it once.
     int i;
+    SK.param.ReserveMore(ssys->params);
     for(i = 0; i < ssys->params; i++) {
         Slvs_Param *sp = &(ssys->param[i]);
         Param p = {};
 
         p.h.v = sp->h;
         p.val = sp->val;
-        SK.param.Add(&p);
+        SK.param.AddUnsorted(&p);
         if(sp->group == shg) {
-            SYS.param.Add(&p);
+            SYS.param.AddUnsorted(&p);
         }
     }
+    SK.param.Sort();
+    SYS.param.Sort();
 
+    SK.entity.ReserveMore(ssys->entities);
     for(i = 0; i < ssys->entities; i++) {
         Slvs_Entity *se = &(ssys->entity[i]);
         EntityBase e = {};
@@ -114,7 +266,7 @@ case SLVS_E_CUBIC:              e.type = Entity::Type::CUBIC; break;
 case SLVS_E_CIRCLE:             e.type = Entity::Type::CIRCLE; break;
 case SLVS_E_ARC_OF_CIRCLE:      e.type = Entity::Type::ARC_OF_CIRCLE; break;
 
-default: dbp("bad entity type %d", se->type); return;
+default: dbp("bad entity type %d", se->type); return false;
         }
         e.h.v           = se->h;
         e.group.v       = se->group;
@@ -130,9 +282,13 @@ default: dbp("bad entity type %d", se->type); return;
         e.param[2].v    = se->param[2];
         e.param[3].v    = se->param[3];
 
-        SK.entity.Add(&e);
+        SK.entity.AddUnsorted(&e);
     }
+    SK.entity.Sort();
+
     IdList<Param, hParam> params = {};
+    ctx->variedParam.assign(ctx->varied.size(), hParam {});
+    SK.constraint.ReserveMore(ssys->constraints);
     for(i = 0; i < ssys->constraints; i++) {
         Slvs_Constraint *sc = &(ssys->constraint[i]);
         ConstraintBase c = {};
@@ -174,7 +330,7 @@ case SLVS_C_PROJ_PT_DISTANCE:   t = Constraint::Type::PROJ_PT_DISTANCE; break;
 case SLVS_C_WHERE_DRAGGED:      t = Constraint::Type::WHERE_DRAGGED; break;
 case SLVS_C_CURVE_CURVE_TANGENT:t = Constraint::Type::CURVE_CURVE_TANGENT; break;
 
-default: dbp("bad constraint type %d", sc->type); return;
+default: dbp("bad constraint type %d", sc->type); return false;
         }
 
         c.type = t;
@@ -192,6 +348,14 @@ default: dbp("bad constraint type %d", sc->type); return;
         c.other         = (sc->other) ? true : false;
         c.other2        = (sc->other2) ? true : false;
 
+        auto vit = std::find(ctx->varied.begin(), ctx->varied.end(), sc->h);
+        if(vit != ctx->varied.end()) {
+            Param p = {};
+            p.val = sc->valA;
+            c.valAParam = SK.param.AddAndAssignId(&p);
+            ctx->variedParam[vit - ctx->varied.begin()] = c.valAParam;
+        }
+
         c.Generate(&params);
         if(params.n > 0) {
             for(Param &p : params) {
@@ -203,8 +367,9 @@ default: dbp("bad constraint type %d", sc->type); return;
             c.ModifyToSatisfy();
         }
 
-        SK.constraint.Add(&c);
+        SK.constraint.AddUnsorted(&c);
     }
+    SK.constraint.Sort();
 
     for(i = 0; i < (int)arraylen(ssys->dragged); i++) {
         if(ssys->dragged[i]) {
@@ -212,6 +377,108 @@ default: dbp("bad constraint type %d", sc->type); return;
             SYS.dragged.Add(&hp);
         }
     }
+    return true;
+}
+
+// Solving the same system again, so copy in the caller's values for it.
+static void LoadValues(Slvs_Context *ctx, Slvs_System *ssys, Slvs_hGroup shg)
+{
+    System &SYS = ctx->sys;
+
+    // The params that the constraints added start from zero, just like they
+    // would if we wrote the system again, so that we get the same answer.
+    for(Param &p : SYS.param) {
+        p.val   = 0;
+        p.guess = 0;
+    }
+    for(int i = 0; i < ssys->params; i++) {
+        Slvs_Param *sp = &(ssys->param[i]);
+        hParam hp = { sp->h };
+        SK.GetParam(hp)->val = sp->val;
+        if(sp->group == shg) {
+            SYS.param.FindById(hp)->val = sp->val;
+        }
+    }
+}
+
+// Guess how far the params that the caller left where we put them will
+// move, for a better place to start from. Between the last two solves they
+// moved some way, because of how the caller moved the others (a dragged
+// point, say); so they'll move that way again, in proportion to how far
+// the caller moved the others along the same direction this time. The
+// system takes only the part of that which the constraints care about.
+// Returns false if there's nothing to go on.
+static bool PredictValues(Slvs_Context *ctx, Slvs_System *ssys, Slvs_hGroup shg)
+{
+    if(ctx->frames < 2) return false;
+
+    int i;
+    double along = 0, before = 0;
+    for(i = 0; i < ssys->params; i++) {
+        Slvs_Param *sp = &(ssys->param[i]);
+        if(sp->group != shg || sp->val == ctx->lastOut[i]) continue;
+        double now  = sp->val - ctx->lastOut[i],
+               then = ctx->lastIn[i] - ctx->prevOut[i];
+        along  += now*then;
+        before += then*then;
+    }
+    if(before == 0 || along == 0) return false;
+    // Don't trust it for a jump much bigger than the last one.
+    double t = std::max(-2.0, std::min(2.0, along/before));
+
+    System &SYS = ctx->sys;
+    for(i = 0; i < ssys->params; i++) {
+        Slvs_Param *sp = &(ssys->param[i]);
+        if(sp->group != shg || sp->val != ctx->lastOut[i]) continue;
+        hParam hp = { sp->h };
+        SYS.param.FindById(hp)->guess = t*(ctx->lastOut[i] - ctx->prevOut[i]);
+    }
+    return true;
+}
+
+static void InitOnce()
+{
+    // A static local is initialized just once, even if several threads get
+    // here at the same time.
+    static bool IsInit = (InitPlatform(0, NULL), true);
+    (void)IsInit;
+}
+
+static void SolveSketch(Slvs_Context *ctx, Slvs_System *ssys, Slvs_hGroup shg)
+{
+    InitOnce();
+
+    System &SYS = ctx->sys;
+    double setupStart = GetSeconds();
+
+    int i;
+    SessionKey key;
+    bool same = false, again = false;
+    if(ctx->keepSession) {
+        WriteSessionKey(ssys, shg, &key);
+        same  = key == ctx->sessionKey;
+        again = SYS.prepared && same;
+    }
+
+    bool predicted = false;
+    if(again) {
+        // The same system as last time, from new values.
+        LoadValues(ctx, ssys, shg);
+        if(ctx->predict) predicted = PredictValues(ctx, ssys, shg);
+    } else if(same && ctx->written) {
+        // Only analyzed so far, so it's all written but the values.
+        LoadValues(ctx, ssys, shg);
+    } else {
+        ClearSession(ctx);
+        if(ctx->keepSession) std::swap(ctx->sessionKey, key);
+        if(!WriteSketch(ctx, ssys, shg)) return;
+    }
+    ctx->written = false;
+
+    for(i = 0; i < (int)ctx->variedParam.size(); i++) {
+        if(ctx->variedParam[i].v == 0) continue;
+        SK.GetParam(ctx->variedParam[i])->val = ctx->variedValue[i];
+    }
 
     Group g = {};
     g.h.v = shg;
@@ -219,8 +486,38 @@ default: dbp("bad constraint type %d", sc->type); return;
     List<hConstraint> bad = {};
 
     // Now we're finally ready to solve!
+    double solveStart = GetSeconds();
     bool andFindBad = ssys->calculateFaileds ? true : false;
-    SolveResult how = SYS.Solve(&g, &(ssys->dof), &bad, andFindBad, /*andFindFree=*/false);
+    SolveResult how;
+    if(again) {
+        how = SYS.SolveAgain(&g, &(ssys->dof), &bad, andFindBad, /*andFindFree=*/false);
+        if(predicted && SYS.prepared &&
+           (how == SolveResult::DIDNT_CONVERGE ||
+            how == SolveResult::REDUNDANT_DIDNT_CONVERGE))
+        {
+            // The guess made it worse, so start from where the caller said.
+            int iterations = SYS.stats.iterations;
+            bad.Clear();
+            LoadValues(ctx, ssys, shg);
+            how = SYS.SolveAgain(&g, &(ssys->dof), &bad, andFindBad, /*andFindFree=*/false);
+            SYS.stats.iterations += iterations;
+        }
+    } else {
+        how = SYS.Solve(&g, &(ssys->dof), &bad, andFindBad, /*andFindFree=*/false);
+    }
+
+    ctx->lastStats.unknowns       = SYS.stats.unknowns;
+    ctx->lastStats.equations      = SYS.stats.equations;
+    ctx->lastStats.nonzeros       = SYS.stats.nonzeros;
+    ctx->lastStats.iterations     = SYS.stats.iterations;
+    ctx->lastStats.setupTime      = solveStart - setupStart;
+    ctx->lastStats.generateTime   = SYS.stats.generateTime;
+    ctx->lastStats.substituteTime = SYS.stats.substituteTime;
+    ctx->lastStats.jacobianTime   = SYS.stats.jacobianTime;
+    ctx->lastStats.evalTime       = SYS.stats.evalTime;
+    ctx->lastStats.solveTime      = SYS.stats.solveTime;
+    ctx->lastStats.rankTime       = SYS.stats.rankTime;
+    ctx->lastStats.totalTime      = GetSeconds() - setupStart;
 
     switch(how) {
         case SolveResult::OKAY:
@@ -241,11 +538,27 @@ default: dbp("bad constraint type %d", sc->type); return;
             break;
     }
 
+    // Remember what went in and what came out, for the next guess; but only
+    // from solves that converged, since the guess needs the factor of the
+    // Jacobian at the solution.
+    bool record = ctx->predict && ctx->keepSession && how == SolveResult::OKAY;
+    if(record) {
+        std::swap(ctx->prevIn, ctx->lastIn);
+        std::swap(ctx->prevOut, ctx->lastOut);
+        ctx->lastIn.resize(ssys->params);
+        ctx->lastOut.resize(ssys->params);
+        ctx->frames++;
+    } else {
+        ctx->frames = 0;
+    }
+
     // Write the new parameter values back to our caller.
     for(i = 0; i < ssys->params; i++) {
         Slvs_Param *sp = &(ssys->param[i]);
         hParam hp = { sp->h };
+        if(record) ctx->lastIn[i] = sp->val;
         sp->val = SK.GetParam(hp)->val;
+        if(record) ctx->lastOut[i] = sp->val;
     }
 
     if(ssys->failed) {
@@ -257,16 +570,246 @@ default: dbp("bad constraint type %d", sc->type); return;
     }
 
     bad.Clear();
-    SYS.param.Clear();
-    SYS.entity.Clear();
-    SYS.eq.Clear();
-    SYS.dragged.Clear();
+    if(!ctx->keepSession) ClearSession(ctx);
+}
 
-    SK.param.Clear();
-    SK.entity.Clear();
-    SK.constraint.Clear();
+// Analyze the structure of the caller's system, and report it like a solve
+// would, but without touching the values of the params.
+static void AnalyzeSketch(Slvs_Context *ctx, Slvs_System *ssys, Slvs_hGroup shg,
+                          Slvs_Structure *st)
+{
+    InitOnce();
+
+    System &SYS = ctx->sys;
+    SessionKey key;
+    bool same = false;
+    if(ctx->keepSession) {
+        WriteSessionKey(ssys, shg, &key);
+        same = key == ctx->sessionKey && (ctx->written || SYS.prepared);
+    }
+    if(!same) {
+        ClearSession(ctx);
+        if(ctx->keepSession) std::swap(ctx->sessionKey, key);
+        if(!WriteSketch(ctx, ssys, shg)) return;
+        ctx->written = true;
+    }
 
-    FreeAllTemporary();
+    if(!ctx->analyzed) {
+        // In a system of its own, so that a prepared solve stays prepared.
+        Group g = {};
+        g.h.v = shg;
+        System sys = {};
+        for(Param &p : SYS.param) {
+            sys.param.Add(&p);
+        }
+        System::Structure s;
+        List<hConstraint> bad = {};
+        sys.AnalyzeStructure(&g, &s, &bad);
+
+        Slvs_Structure *cs = &(ctx->structure);
+        cs->unknowns       = s.unknowns;
+        cs->equations      = s.equations;
+        cs->dof            = s.unknowns - s.matched;
+        cs->redundant      = s.equations - s.matched;
+        cs->overUnknowns   = s.overUnknowns;
+        cs->overEquations  = s.overEquations;
+        cs->underUnknowns  = s.underUnknowns;
+        cs->underEquations = s.underEquations;
+        ctx->structureFailed.clear();
+        for(hConstraint &hc : bad) {
+            ctx->structureFailed.push_back(hc.v);
+        }
+        bad.Clear();
+        sys.Clear();
+        ctx->analyzed = true;
+    }
+
+    const Slvs_Structure *cs = &(ctx->structure);
+    if(st) *st = *cs;
+    ssys->dof    = cs->dof;
+    ssys->result = (cs->overEquations > 0) ? SLVS_RESULT_INCONSISTENT :
+                                             SLVS_RESULT_OKAY;
+    if(ssys->failed) {
+        int n = (int)ctx->structureFailed.size();
+        for(int i = 0; i < ssys->faileds && i < n; i++) {
+            ssys->failed[i] = ctx->structureFailed[i];
+        }
+        ssys->faileds = n;
+    }
+
+    if(!ctx->keepSession) ClearSession(ctx);
+}
+
+Slvs_Context *Slvs_CreateContext(void)
+{
+    Slvs_Context *ctx = new Slvs_Context();
+    ctx->keepSession = true;
+    return ctx;
+}
+
+void Slvs_DestroyContext(Slvs_Context *ctx)
+{
+    if(ctx == NULL || ctx == &DefaultContext) return;
+
+    TemporaryHeap *oldHeap = SetTemporaryHeap(&(ctx->heap));
+    ClearSession(ctx);
+    SetTemporaryHeap(oldHeap);
+
+    delete ctx;
+}
+
+void Slvs_SolveInContext(Slvs_Context *ctx, Slvs_System *ssys, Slvs_hGroup shg)
+{
+    // Point SK and the temporary heap at this context's own for the
+    // duration, and restore whatever this thread had before.
+    Sketch *oldSketch = ActiveSketch;
+    ActiveSketch = &(ctx->sketch);
+    TemporaryHeap *oldHeap = SetTemporaryHeap(&(ctx->heap));
+
+    SolveSketch(ctx, ssys, shg);
+
+    SetTemporaryHeap(oldHeap);
+    ActiveSketch = oldSketch;
+}
+
+void Slvs_AnalyzeStructureInContext(Slvs_Context *ctx, Slvs_System *ssys,
+                                    Slvs_hGroup shg, Slvs_Structure *st)
+{
+    Sketch *oldSketch = ActiveSketch;
+    ActiveSketch = &(ctx->sketch);
+    TemporaryHeap *oldHeap = SetTemporaryHeap(&(ctx->heap));
+
+    AnalyzeSketch(ctx, ssys, shg, st);
+
+    SetTemporaryHeap(oldHeap);
+    ActiveSketch = oldSketch;
+}
+
+void Slvs_GetContextSolveStats(Slvs_Context *ctx, Slvs_SolveStats *stats)
+{
+    *stats = ctx->lastStats;
+}
+
+int Slvs_SetContextLinearSolver(Slvs_Context *ctx, int solver)
+{
+    // The predictor needs the factor from the last solve, so it has to
+    // wait for the next two with this backend.
+    ctx->frames = 0;
+
+    switch(solver) {
+        case SLVS_SOLVER_AUTO:
+            ctx->sys.backend = System::Backend::AUTO;
+            return 1;
+
+        case SLVS_SOLVER_SPARSE:
+            ctx->sys.backend = System::Backend::SPARSE;
+            return 1;
+
+        case SLVS_SOLVER_DENSE:
+            if(!System::HAVE_DENSE_BACKEND) return 0;
+            ctx->sys.backend = System::Backend::DENSE;
+            return 1;
+    }
+    return 0;
+}
+
+void Slvs_SetContextPredictor(Slvs_Context *ctx, int predict)
+{
+    ctx->predict = predict ? true : false;
+    ctx->frames  = 0;
+}
+
+int Slvs_SetContextSolverMethod(Slvs_Context *ctx, int method)
+{
+    switch(method) {
+        case SLVS_METHOD_NEWTON:
+            ctx->sys.method = System::Method::NEWTON;
+            return 1;
+
+        case SLVS_METHOD_LEVENBERG_MARQUARDT:
+            ctx->sys.method = System::Method::LEVENBERG_MARQUARDT;
+            return 1;
+    }
+    return 0;
+}
+
+void Slvs_SetContextParallelThreshold(Slvs_Context *ctx, int equations)
+{
+    ctx->sys.parallelRows = equations;
+}
+
+void Slvs_Solve(Slvs_System *ssys, Slvs_hGroup shg)
+{
+    Slvs_SolveInContext(&DefaultContext, ssys, shg);
+}
+
+void Slvs_AnalyzeStructure(Slvs_System *ssys, Slvs_hGroup shg, Slvs_Structure *st)
+{
+    Slvs_AnalyzeStructureInContext(&DefaultContext, ssys, shg, st);
+}
+
+void Slvs_SolveBatch(const Slvs_System *ssys, Slvs_hGroup shg,
+                     const Slvs_hConstraint *varied, int varieds,
+                     const double *values, int variants,
+                     double *params, int *results)
+{
+    if(variants <= 0) return;
+
+    std::atomic<int> next(0);
+    int lanes = std::min(variants, ParallelThreads());
+    ParallelFor(lanes, [&](int) {
+        // Each lane writes the system once, in a context of its own, and
+        // then solves it again for each variant that it takes.
+        Slvs_Context *ctx = Slvs_CreateContext();
+        ctx->sys.backend      = DefaultContext.sys.backend;
+        ctx->sys.method       = DefaultContext.sys.method;
+        ctx->sys.parallelRows = DefaultContext.sys.parallelRows;
+        ctx->varied.assign(varied, varied + varieds);
+        ctx->variedValue.resize(varieds);
+
+        std::vector<Slvs_Param> param(ssys->params);
+        Slvs_System sys = *ssys;
+        sys.param            = param.data();
+        sys.failed           = NULL;
+        sys.faileds          = 0;
+        sys.calculateFaileds = 0;
+
+        int v, i;
+        while((v = next++) < variants) {
+            std::copy(ssys->param, ssys->param + ssys->params, param.begin());
+            const double *value = values + (size_t)v*varieds;
+            std::copy(value, value + varieds, ctx->variedValue.begin());
+
+            Slvs_SolveInContext(ctx, &sys, shg);
+
+            double *out = params + (size_t)v*ssys->params;
+            for(i = 0; i < ssys->params; i++) {
+                out[i] = param[i].val;
+            }
+            results[v] = sys.result;
+        }
+        Slvs_DestroyContext(ctx);
+    });
+}
+
+void Slvs_GetLastSolveStats(Slvs_SolveStats *stats)
+{
+    Slvs_GetContextSolveStats(&DefaultContext, stats);
+}
+
+int Slvs_SetLinearSolver(int solver)
+{
+    return Slvs_SetContextLinearSolver(&DefaultContext, solver);
+}
+
+int Slvs_SetSolverMethod(int method)
+{
+    return Slvs_SetContextSolverMethod(&DefaultContext, method);
+}
+
+void Slvs_SetParallelThreshold(int equations)
+{
+    Slvs_SetContextParallelThreshold(&DefaultContext, equations);
 }
 
 } /* extern "C" */
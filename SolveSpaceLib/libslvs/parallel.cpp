@@ -0,0 +1,133 @@
+//-----------------------------------------------------------------------------
+// A pool of worker threads, so that we can solve the independent parts of a
+// system at the same time. There's one pool for the whole process, started
+// the first time that it's needed, and any number of threads (e.g., one for
+// each solver context) can hand it work at once.
+//-----------------------------------------------------------------------------
+#include "solvespace.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace SolveSpace {
+
+namespace {
+
+struct ParallelJob {
+    const std::function<void(int)> *fn;
+    int                 n;
+    // The next item that nobody has started yet
+    std::atomic<int>    next;
+
+    // These are guarded by the pool's mutex.
+    int                 done;
+    // The workers that are still looking at this job; it lives on its
+    // caller's stack, so that can't return until they're finished with it.
+    int                 active;
+};
+
+class ThreadPool {
+public:
+    std::mutex                  mutex;
+    std::condition_variable     workToDo;
+    std::condition_variable     workDone;
+    std::vector<ParallelJob *>  jobs;
+    int                         threads;
+
+    explicit ThreadPool(int threads) : threads(threads) {
+        for(int i = 0; i < threads; i++) {
+            std::thread(&ThreadPool::Worker, this).detach();
+        }
+    }
+
+    // Run items of the job until there are none left to start, and return
+    // how many of them we ran.
+    static int RunItems(ParallelJob *job) {
+        int i, count = 0;
+        while((i = job->next++) < job->n) {
+            (*job->fn)(i);
+            count++;
+        }
+        return count;
+    }
+
+    // Called with the mutex held, once we've run all that we can of a job.
+    void Finished(ParallelJob *job, int count) {
+        // Everything has been started, so there's nothing left for anyone
+        // else to pick up.
+        auto it = std::find(jobs.begin(), jobs.end(), job);
+        if(it != jobs.end()) jobs.erase(it);
+
+        job->done += count;
+        if(job->done == job->n && job->active == 0) workDone.notify_all();
+    }
+
+    void Worker() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            workToDo.wait(lock, [this] { return !jobs.empty(); });
+            ParallelJob *job = jobs.front();
+            job->active++;
+
+            lock.unlock();
+            int count = RunItems(job);
+            lock.lock();
+
+            job->active--;
+            Finished(job, count);
+        }
+    }
+
+    void Run(ParallelJob *job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        workToDo.notify_all();
+
+        // Help out, instead of just waiting.
+        int count = RunItems(job);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        Finished(job, count);
+        workDone.wait(lock, [job] {
+            return job->done == job->n && job->active == 0;
+        });
+    }
+};
+
+ThreadPool *GetThreadPool() {
+    // The calling thread works too, so one less than the number of cores.
+    // This is never freed, since the workers run until the process exits.
+    static ThreadPool *pool =
+        new ThreadPool(std::max(0, (int)std::thread::hardware_concurrency() - 1));
+    return pool;
+}
+
+}
+
+int ParallelThreads() {
+    return GetThreadPool()->threads + 1;
+}
+
+void ParallelFor(int n, const std::function<void(int)> &fn) {
+    ThreadPool *pool = (n > 1) ? GetThreadPool() : NULL;
+    if(pool == NULL || pool->threads == 0) {
+        for(int i = 0; i < n; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    ParallelJob job;
+    job.fn     = &fn;
+    job.n      = n;
+    job.next   = 0;
+    job.done   = 0;
+    job.active = 0;
+    pool->Run(&job);
+}
+
+}
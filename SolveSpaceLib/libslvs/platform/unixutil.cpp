@@ -11,6 +11,8 @@
 #include <execinfo.h>
 #endif
 
+#include <cstddef>
+
 #include "solvespace.h"
 
 namespace SolveSpace {
@@ -18,7 +20,7 @@ namespace SolveSpace {
 void dbp(const char *str, ...)
 {
     va_list f;
-    static char buf[1024*50];
+    static thread_local char buf[1024*50];
     va_start(f, str);
     vsnprintf(buf, sizeof(buf), str, f);
     va_end(f);
@@ -53,54 +55,92 @@ void assert_failure(const char *file, unsigned line, const char *function,
 }
 
 //-----------------------------------------------------------------------------
-// A separate heap, on which we allocate expressions. Maybe a bit faster,
-// since fragmentation is less of a concern, and it also makes it possible
-// to be sloppy with our memory management, and just free everything at once
-// at the end.
+// A separate heap, on which we allocate expressions. We get it from the
+// system in big chunks, and allocate from the newest chunk by bumping a
+// pointer, so that an allocation costs next to nothing and there's no
+// per-allocation overhead; and it also makes it possible to be sloppy with
+// our memory management, and just free everything at once at the end. Each
+// thread allocates from its current heap, so solves on different threads
+// never touch the same one.
 //-----------------------------------------------------------------------------
 
-typedef struct _AllocTempHeader AllocTempHeader;
+struct AllocTempChunk {
+    AllocTempChunk *next;
+    // The space after the header
+    size_t          size;
+};
 
-typedef struct _AllocTempHeader {
-    AllocTempHeader *prev;
-    AllocTempHeader *next;
-} AllocTempHeader;
+static const size_t ALLOC_TEMP_ALIGN = alignof(std::max_align_t);
+static const size_t ALLOC_TEMP_CHUNK = 256*1024;
 
-static AllocTempHeader *Head = NULL;
+static size_t AlignTemporary(size_t n) {
+    return (n + ALLOC_TEMP_ALIGN - 1) & ~(ALLOC_TEMP_ALIGN - 1);
+}
 
-void *AllocTemporary(size_t n)
+static thread_local TemporaryHeap DefaultHeap = {};
+static thread_local TemporaryHeap *Heap = &DefaultHeap;
+
+// Make a heap current on this thread (or the thread's own default heap, if
+// heap is NULL), and return the one that was.
+TemporaryHeap *SetTemporaryHeap(TemporaryHeap *heap)
 {
-    AllocTempHeader *h =
-        (AllocTempHeader *)malloc(n + sizeof(AllocTempHeader));
-    h->prev = NULL;
-    h->next = Head;
-    if(Head) Head->prev = h;
-    Head = h;
-    memset(&h[1], 0, n);
-    return (void *)&h[1];
+    TemporaryHeap *old = Heap;
+    Heap = heap ? heap : &DefaultHeap;
+    return old;
 }
 
-void FreeTemporary(void *p)
+void *AllocTemporary(size_t n)
 {
-    AllocTempHeader *h = (AllocTempHeader *)p - 1;
-    if(h->prev) {
-        h->prev->next = h->next;
-    } else {
-        Head = h->next;
+    const size_t header = AlignTemporary(sizeof(AllocTempChunk));
+    n = AlignTemporary(n);
+
+    if(Heap->head == NULL || Heap->used + n > Heap->head->size) {
+        // Anything too big for a chunk gets one of its own.
+        size_t size = std::max(n, ALLOC_TEMP_CHUNK);
+        AllocTempChunk *c = (AllocTempChunk *)MemAlloc(header + size);
+        c->next = Heap->head;
+        c->size = size;
+        Heap->head = c;
+        Heap->used = 0;
     }
-    if(h->next) h->next->prev = h->prev;
-    free(h);
+
+    void *p = (char *)Heap->head + header + Heap->used;
+    Heap->used += n;
+    memset(p, 0, n);
+    return p;
+}
+
+void FreeTemporary(void *)
+{
+    // Nothing to do; the space comes back when we free everything.
 }
 
 void FreeAllTemporary(void)
 {
-    AllocTempHeader *h = Head;
-    while(h) {
-        AllocTempHeader *f = h;
-        h = h->next;
-        free(f);
+    // Keep one ordinary chunk, so that the next solve can start allocating
+    // right away.
+    AllocTempChunk *keep = NULL, *c = Heap->head;
+    while(c) {
+        AllocTempChunk *next = c->next;
+        if(keep == NULL && c->size == ALLOC_TEMP_CHUNK) {
+            keep = c;
+            keep->next = NULL;
+        } else {
+            MemFree(c);
+        }
+        c = next;
+    }
+    Heap->head = keep;
+    Heap->used = 0;
+}
+
+TemporaryHeap::~TemporaryHeap()
+{
+    while(head) {
+        AllocTempChunk *next = head->next;
+        MemFree(head);
+        head = next;
     }
-    Head = NULL;
 }
 
 void *MemAlloc(size_t n) {
@@ -113,6 +153,11 @@ void MemFree(void *p) {
     free(p);
 }
 
+double GetSeconds() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
 std::vector<std::string> InitPlatform(int argc, char **argv) {
     std::vector<std::string> args;
     for(int i = 0; i < argc; i++) {
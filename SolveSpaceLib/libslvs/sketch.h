@@ -572,6 +572,8 @@ public:
 
     // Used only in the solver
     hParam      substd;
+    // How far we guess that a solve will move it
+    double      guess;
 
     static const hParam NO_PARAM;
 
@@ -641,6 +643,9 @@ public:
     // These are the parameters for the constraint.
     double      valA;
     hParam      valP;
+    // If this is set, then the equations read valA from this (known) param
+    // instead, so that it can change without writing them again.
+    hParam      valAParam;
     hEntity     ptA;
     hEntity     ptB;
     hEntity     entityA;
@@ -737,9 +742,11 @@ public:
                                     bool other, bool other2);
 };
 
+// Wider than the other handles, so that a constraint's handle still fits
+// whole when it's shifted up to make room for the index of its equation.
 class hEquation {
 public:
-    uint32_t v;
+    uint64_t v;
 
     inline bool isFromConstraint() const;
     inline hConstraint constraint() const;
@@ -868,7 +875,7 @@ inline hEntity hGroup::entity(int i) const
 inline hParam hGroup::param(int i) const
     { hParam r; r.v = 0x80000000 | (v << 16) | (uint32_t)i; return r; }
 inline hEquation hGroup::equation(int i) const
-    { hEquation r; r.v = (v << 16) | 0x80000000 | (uint32_t)i; return r; }
+    { hEquation r; r.v = ((uint64_t)v << 16) | 0x8000000000000000 | (uint32_t)i; return r; }
 
 inline bool hRequest::IsFromReferences() const {
     if(v == Request::HREQUEST_REFERENCE_XY.v) return true;
@@ -888,21 +895,21 @@ inline hRequest hEntity::request() const
 inline hGroup hEntity::group() const
     { hGroup r; r.v = (v >> 16) & 0x3fff; return r; }
 inline hEquation hEntity::equation(int i) const
-    { hEquation r; r.v = v | 0x40000000 | (uint32_t)i; return r; }
+    { hEquation r; r.v = (uint64_t)v | 0x4000000000000000 | (uint32_t)i; return r; }
 
 inline hRequest hParam::request() const
     { hRequest r; r.v = (v >> 16); return r; }
 
 
 inline hEquation hConstraint::equation(int i) const
-    { hEquation r; r.v = (v << 16) | (uint32_t)i; return r; }
+    { hEquation r; r.v = ((uint64_t)v << 16) | (uint32_t)i; return r; }
 inline hParam hConstraint::param(int i) const
     { hParam r; r.v = v | 0x40000000 | (uint32_t)i; return r; }
 
 inline bool hEquation::isFromConstraint() const
-    { if(v & 0xc0000000) return false; else return true; }
+    { if(v & 0xc000000000000000) return false; else return true; }
 inline hConstraint hEquation::constraint() const
-    { hConstraint r; r.v = (v >> 16); return r; }
+    { hConstraint r; r.v = (uint32_t)(v >> 16); return r; }
 
 // The format for entities stored on the clipboard.
 class ClipboardRequest {
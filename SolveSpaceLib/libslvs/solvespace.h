@@ -245,12 +245,41 @@ float CnfThawFloat(float val, const std::string &name);
 
 std::vector<std::string> InitPlatform(int argc, char **argv);
 
+// The temporary heap, that AllocTemporary() allocates from and that
+// FreeAllTemporary() frees all at once. Each thread has one of its own,
+// and a solver context can make its own heap current on its thread.
+struct AllocTempChunk;
+class TemporaryHeap {
+public:
+    // The chunk that we're allocating from, and how much of it is used
+    AllocTempChunk *head;
+    size_t          used;
+
+    TemporaryHeap() : head(NULL), used(0) {}
+    TemporaryHeap(const TemporaryHeap &) = delete;
+    TemporaryHeap &operator=(const TemporaryHeap &) = delete;
+    ~TemporaryHeap();
+};
+TemporaryHeap *SetTemporaryHeap(TemporaryHeap *heap);
+
 void *AllocTemporary(size_t n);
 void FreeTemporary(void *p);
 void FreeAllTemporary();
 void *MemAlloc(size_t n);
 void MemFree(void *p);
 
+double GetSeconds();
+
+// Call fn(0) through fn(n - 1), spread over a pool of worker threads (and
+// the calling thread, which helps out), and return once they're all done.
+void ParallelFor(int n, const std::function<void(int)> &fn);
+// How many items of a ParallelFor() can run at once.
+int ParallelThreads();
+
+// y[k] -= x[k]*s for k < n, vectorized for the best instruction set that
+// the CPU has; the arrays mustn't overlap.
+void SubtractScaled(double *y, const double *x, int n, double s);
+
 #if FULL_LIB_JJS
 void vl(); // debug function to validate heaps
 #endif
@@ -339,10 +368,91 @@ void CnfFreezeColor(RgbaColor v, const std::string &name);
 bool CnfThawBool(bool v, const std::string &name);
 RgbaColor CnfThawColor(RgbaColor v, const std::string &name);
 
-class System {
+// A sparse matrix, stored by rows in compressed form: the nonzeros of row i
+// are at [rowStart[i], rowStart[i+1]), in order of increasing column. The
+// same nonzeros are also indexed by columns; entry k of column j is the
+// element at index colEntry[k] in the row arrays, for k in
+// [colStart[j], colStart[j+1]), in order of increasing row.
+class SparseMatrix {
 public:
-    enum { MAX_UNKNOWNS = 1024 };
+    std::vector<int>     rowStart;
+    std::vector<int>     col;
+    std::vector<double>  num;
+    // The register of the unknown that each entry is the partial with
+    // respect to, on the tape of the residuals that we differentiate
+    std::vector<int>     wrt;
+
+    std::vector<int>     colStart;
+    std::vector<int>     row;
+    std::vector<int>     colEntry;
+
+    int Rows() const { return (int)rowStart.size() - 1; }
+    int Cols() const { return (int)colStart.size() - 1; }
+};
+
+// Factors A*A' for a sparse A, to solve the normal equations that we get in
+// the least squares solve. The symbolic work (a fill-reducing ordering, the
+// elimination tree, and the pattern of the factor) depends only on where the
+// nonzeros of A are, so it's kept until a matrix with a different pattern
+// comes along. The numeric factorization is an LDL', with a Q-less QR of A'
+// into the same pattern for when the normal equations are too badly
+// conditioned to trust.
+class SparseSolver {
+public:
+    // The pattern of A that we analyzed
+    std::vector<int>    keyRowStart;
+    std::vector<int>    keyCol;
+    int                 m;
+
+    // Row k of the permuted A*A' is row perm[k] of the original.
+    std::vector<int>    perm;
+    std::vector<int>    iperm;
+
+    // The strictly upper triangle of the permuted A*A', by columns
+    std::vector<int>    upStart;
+    std::vector<int>    upRow;
+
+    // The elimination tree, and the pattern of L by columns (which is also
+    // the pattern of R by rows).
+    std::vector<int>    parent;
+    std::vector<int>    lStart;
+    std::vector<int>    lRow;
+    // Whether the rows in each column of L are consecutive, as they are
+    // wherever the factor fills in; then we can work on the column with
+    // SubtractScaled(), instead of going through lRow.
+    std::vector<bool>   lConsecutive;
+
+    // The columns of A, in the order that the QR takes them as rows of A'
+    std::vector<int>    qrOrder;
+
+    // The numeric factorization; for the QR, d is the diagonal of R and lVal
+    // the rest of it.
+    bool                isQr;
+    std::vector<double> lVal;
+    std::vector<double> d;
+    std::vector<bool>   dropped;
+    // Of the pivots that we kept, the smallest relative to the magnitude
+    // squared of its row of A.
+    double              worstPivot;
+
+    std::vector<double> y;
+    std::vector<double> t;
+    std::vector<int>    flag;
+    std::vector<int>    pattern;
+    std::vector<int>    lCount;
+
+    void Analyze(const SparseMatrix &A);
+    int FactorLdl(const SparseMatrix &A, double absTol, double relTol,
+                  double shift = 0);
+    int FactorQr(const SparseMatrix &A, double absTol, double relTol);
+    void SubtractColumn(int k, double *x, double s);
+    void SolveFactored(double *x);
+    void Solve(const SparseMatrix &A, double *z, const double *b);
+    void FindDependency(int k, std::vector<std::pair<int, double>> *dep);
+};
 
+class System {
+public:
     EntityList                      entity;
     ParamList                       param;
     IdList<Equation,hEquation>      eq;
@@ -351,67 +461,166 @@ public:
     // we should put as close as possible to their initial positions.
     List<hParam>                    dragged;
 
+    // How we factor the normal equations. The dense backend uses LAPACK,
+    // and exists only if we were built with it; AUTO picks it for systems
+    // that are mid-sized and whose factor would be mostly full anyway.
+    enum class Backend : uint32_t {
+        AUTO                 = 0,
+        SPARSE               = 1,
+        DENSE                = 2
+    };
+    Backend                         backend;
+    static const bool               HAVE_DENSE_BACKEND;
+
+    // How we step towards the solution: full Newton steps, or steps damped
+    // by Levenberg-Marquardt, which converges from further away.
+    enum class Method : uint32_t {
+        NEWTON               = 0,
+        LEVENBERG_MARQUARDT  = 1
+    };
+    Method                          method;
+
+    // Evaluate the Jacobian and the residuals on the thread pool, a chunk
+    // of rows at a time, if there are at least this many rows; never if
+    // it's negative, and DEFAULT_PARALLEL_ROWS if it's zero.
+    int                             parallelRows;
+    static const int                DEFAULT_PARALLEL_ROWS;
+    static const int                PARALLEL_CHUNK_ROWS;
+    bool EvalInParallel();
+
     enum {
         // In general, the tag indicates the subsys that a variable/equation
         // has been assigned to; these are exceptions for variables:
         VAR_SUBSTITUTED      = 10000,
         VAR_DOF_TEST         = 10001,
+        VAR_SOLVED_ALONE     = 10002,
         // and for equations:
-        EQ_SUBSTITUTED       = 20000
+        EQ_SUBSTITUTED       = 20000,
+        EQ_SOLVED_ALONE      = 20001
     };
 
-    // The system Jacobian matrix
+    // The system Jacobian matrix; everything here is sized by WriteJacobian
+    // to fit the system, so there's no limit on the number of unknowns.
     struct {
         // The corresponding equation for each row
-        hEquation   eq[MAX_UNKNOWNS];
+        std::vector<hEquation>  eq;
 
         // The corresponding parameter for each column
-        hParam      param[MAX_UNKNOWNS];
+        std::vector<hParam>     param;
 
         // We're solving AX = B
         int m, n;
-        struct {
-            Expr        *sym[MAX_UNKNOWNS][MAX_UNKNOWNS];
-            double       num[MAX_UNKNOWNS][MAX_UNKNOWNS];
-        }           A;
+        SparseMatrix            A;
 
-        double      scale[MAX_UNKNOWNS];
+        std::vector<double>     scale;
 
         // Some helpers for the least squares solve
-        double AAt[MAX_UNKNOWNS][MAX_UNKNOWNS];
-        double Z[MAX_UNKNOWNS];
+        SparseSolver            factor;
+        // Whether that's the rank test's factor of A*A', with A as it is
+        // now, and good enough that the Newton step would factor it the
+        // same way; then it can use this one.
+        bool                    rankFactored;
+        std::vector<double>     Z;
 
-        double      X[MAX_UNKNOWNS];
+        std::vector<double>     X;
 
         struct {
-            Expr        *sym[MAX_UNKNOWNS];
-            double       num[MAX_UNKNOWNS];
+            std::vector<double>  num;
+            ExprTape             tape;
         }           B;
     } mat;
 
+    // The equations that we can solve alone, each for the one unknown that
+    // it refers to, before we solve the rest.
+    struct {
+        std::vector<hEquation>  eq;
+        std::vector<Param *>    param;
+        // The register of that unknown in the tape, or -1 if it folded away
+        std::vector<int>        wrt;
+        ExprTape                tape;
+        std::vector<double>     f;
+    } alone;
+
+    // What's left after those, if it falls apart in to independent parts,
+    // and the number of unknowns that no equation refers to.
+    std::vector<System>             parts;
+    int                             unreferenced;
+
+    // Whether all of the above is ready for SolvePrepared(), so that we can
+    // solve the same equations again from new values without writing them
+    // again.
+    bool                            prepared;
+
+    // Where the time went in the last solve, so that we can see how the
+    // cost of each step grows with the size of the system. The sizes are
+    // those of the Jacobian left after substitution, and the times are in
+    // seconds.
+    struct {
+        int     unknowns, equations, nonzeros;
+        int     iterations;
+        double  generateTime;
+        double  substituteTime;
+        double  jacobianTime;
+        double  evalTime;
+        double  solveTime;
+        double  rankTime;
+    } stats;
+
+    // What the structure of the equations says, from which unknowns each
+    // one refers to and not from their values: how many equations a
+    // maximum matching pairs up with unknowns of their own, and the sizes
+    // of the over- and under-constrained parts of the Dulmage-Mendelsohn
+    // decomposition.
+    struct Structure {
+        int     unknowns, equations, matched;
+        int     overUnknowns, overEquations;
+        int     underUnknowns, underEquations;
+    };
+
     static const double RANK_MAG_TOLERANCE, CONVERGE_TOLERANCE;
+    static const double PIVOT_TOLERANCE, ILL_CONDITIONED;
     int CalculateRank();
     bool TestRank();
-    static bool SolveLinearSystem(double X[], double A[][MAX_UNKNOWNS],
-                                  double B[], int N);
-    bool SolveLeastSquares();
+    bool SolveLeastSquares(double damping = 0);
+
+    bool UseDenseBackend();
+    int CalculateRankDense();
+    bool SolveLeastSquaresDense(double damping);
 
-    bool WriteJacobian(int tag);
+    void WriteJacobian(int tag);
     void EvalJacobian();
+    void EvalResiduals();
 
     void WriteEquationsExceptFor(hConstraint hc, Group *g);
     void FindWhichToRemoveToFixJacobian(Group *g, List<hConstraint> *bad, bool forceDofCheck);
+    void FindWhichToRemoveOneByOne(Group *g, List<hConstraint> *bad, bool forceDofCheck);
     void SolveBySubstitution();
 
+    void WriteAlone();
+    bool SolveAlone();
+
+    int SplitInToParts(std::vector<System> *parts);
+    void AnalyzeStructure(Group *g, Structure *s, List<hConstraint> *bad);
+    SolveResult SolvePart(bool andFindFree);
+
     bool IsDragged(hParam p);
 
+    void StartFromGuess();
     bool NewtonSolve(int tag);
+    bool ResidualsConverged();
+    bool SolveLevenbergMarquardt();
 
     void MarkParamsFree(bool findFree);
     int CalculateDof();
 
+    void Prepare(Group *g, bool forceDofCheck);
+    SolveResult SolvePrepared(Group *g, int *dof, List<hConstraint> *bad,
+                              bool andFindBad, bool andFindFree, bool forceDofCheck);
+
     SolveResult Solve(Group *g, int *dof, List<hConstraint> *bad,
                       bool andFindBad, bool andFindFree, bool forceDofCheck = false);
+    SolveResult SolveAgain(Group *g, int *dof, List<hConstraint> *bad,
+                           bool andFindBad, bool andFindFree, bool forceDofCheck = false);
 
     SolveResult SolveRank(Group *g, int *dof, List<hConstraint> *bad,
                           bool andFindBad, bool andFindFree, bool forceDofCheck = false);
@@ -924,7 +1133,11 @@ void ImportDwg(const Platform::Path &file);
 
 extern SolveSpaceUI SS;
 #endif
-extern Sketch SK;
+// The sketch that we're solving. The library keeps one of these in each
+// solver context, so SK is whichever one belongs to the context that's
+// solving on this thread.
+extern thread_local Sketch *ActiveSketch;
+#define SK (*SolveSpace::ActiveSketch)
 
 }
 
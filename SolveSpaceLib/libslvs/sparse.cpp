@@ -0,0 +1,454 @@
+//-----------------------------------------------------------------------------
+// Sparse factorization of the normal equations A*A' that we solve for each
+// Newton step, and for the rank tests. A sketch's Jacobian is very sparse,
+// since each equation refers to only a few parameters, and so is A*A'; if
+// we order the rows well, then the factor stays sparse too.
+//-----------------------------------------------------------------------------
+#include "solvespace.h"
+
+#include <queue>
+
+//-----------------------------------------------------------------------------
+// A minimum degree ordering of a symmetric graph: repeatedly eliminate the
+// vertex with the fewest neighbors, and join up all of its neighbors (which
+// is the fill that eliminating it creates). Ties go to the lowest numbered
+// vertex, so that the ordering is repeatable.
+//-----------------------------------------------------------------------------
+static void MinimumDegreeOrder(std::vector<std::vector<int>> *adj,
+                               std::vector<int> *perm)
+{
+    int n = (int)adj->size();
+    std::vector<bool> eliminated(n, false);
+    std::vector<int> mark(n, -1);
+    std::vector<int> nbrs, merged;
+
+    typedef std::pair<int, int> DegreeVertex;
+    std::priority_queue<DegreeVertex, std::vector<DegreeVertex>,
+                        std::greater<DegreeVertex>> queue;
+    int i;
+    for(i = 0; i < n; i++) {
+        queue.push(DegreeVertex((int)(*adj)[i].size(), i));
+    }
+
+    perm->clear();
+    while(!queue.empty()) {
+        DegreeVertex dv = queue.top();
+        queue.pop();
+        int v = dv.second;
+        // Skip the stale entries, left over from before a degree changed.
+        if(eliminated[v] || dv.first != (int)(*adj)[v].size()) continue;
+
+        eliminated[v] = true;
+        perm->push_back(v);
+
+        nbrs.swap((*adj)[v]);
+        (*adj)[v].clear();
+        for(int u : nbrs) {
+            // The new neighbors of u are its old ones, less v, plus the
+            // other neighbors of v.
+            merged.clear();
+            for(int w : (*adj)[u]) {
+                if(w == v) continue;
+                mark[w] = u;
+                merged.push_back(w);
+            }
+            for(int w : nbrs) {
+                if(w == u || mark[w] == u) continue;
+                mark[w] = u;
+                merged.push_back(w);
+            }
+            (*adj)[u].swap(merged);
+            queue.push(DegreeVertex((int)(*adj)[u].size(), u));
+        }
+        // Reset the marks, since a vertex number is reused as a mark.
+        for(int u : nbrs) {
+            for(int w : (*adj)[u]) mark[w] = -1;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Do the symbolic part of the factorization for the pattern of A, unless
+// that's the same pattern that we analyzed last time.
+//-----------------------------------------------------------------------------
+void SparseSolver::Analyze(const SparseMatrix &A) {
+    if(A.rowStart == keyRowStart && A.col == keyCol) return;
+    keyRowStart = A.rowStart;
+    keyCol      = A.col;
+
+    m = A.Rows();
+    int n = A.Cols();
+    int i, j, k, p, r;
+
+    // The graph of A*A'; two rows are adjacent if they share a column.
+    std::vector<std::vector<int>> adj(m);
+    std::vector<int> mark(m, -1);
+    for(r = 0; r < m; r++) {
+        mark[r] = r;
+        for(p = A.rowStart[r]; p < A.rowStart[r + 1]; p++) {
+            j = A.col[p];
+            for(int q = A.colStart[j]; q < A.colStart[j + 1]; q++) {
+                int r2 = A.row[q];
+                if(mark[r2] == r) continue;
+                mark[r2] = r;
+                adj[r].push_back(r2);
+            }
+        }
+    }
+
+    // The ordering consumes the graph, so give it a copy; we still need
+    // the graph to write its upper triangle in the new order.
+    std::vector<std::vector<int>> work = adj;
+    MinimumDegreeOrder(&work, &perm);
+    iperm.resize(m);
+    for(k = 0; k < m; k++) {
+        iperm[perm[k]] = k;
+    }
+
+    upStart.assign(m + 1, 0);
+    upRow.clear();
+    for(k = 0; k < m; k++) {
+        for(int r2 : adj[perm[k]]) {
+            i = iperm[r2];
+            if(i < k) upRow.push_back(i);
+        }
+        upStart[k + 1] = (int)upRow.size();
+    }
+
+    // The elimination tree, and the number of nonzeros in each column of L.
+    parent.assign(m, -1);
+    flag.assign(m, -1);
+    lCount.assign(m, 0);
+    for(k = 0; k < m; k++) {
+        flag[k] = k;
+        for(p = upStart[k]; p < upStart[k + 1]; p++) {
+            for(i = upRow[p]; flag[i] != k; i = parent[i]) {
+                if(parent[i] == -1) parent[i] = k;
+                lCount[i]++;
+                flag[i] = k;
+            }
+        }
+    }
+    lStart.assign(m + 1, 0);
+    for(k = 0; k < m; k++) {
+        lStart[k + 1] = lStart[k] + lCount[k];
+    }
+
+    // And where those nonzeros are; row k of L is the set of vertices that
+    // we reach by walking up the tree from the nonzeros in column k of the
+    // upper triangle, so each column of L comes out in order of increasing
+    // row.
+    lRow.resize(lStart[m]);
+    flag.assign(m, -1);
+    lCount.assign(m, 0);
+    for(k = 0; k < m; k++) {
+        flag[k] = k;
+        for(p = upStart[k]; p < upStart[k + 1]; p++) {
+            for(i = upRow[p]; flag[i] != k; i = parent[i]) {
+                lRow[lStart[i] + lCount[i]] = k;
+                lCount[i]++;
+                flag[i] = k;
+            }
+        }
+    }
+    lConsecutive.assign(m, false);
+    for(k = 0; k < m; k++) {
+        int len = lStart[k + 1] - lStart[k];
+        lConsecutive[k] = (len > 0 &&
+                           lRow[lStart[k + 1] - 1] - lRow[lStart[k]] == len - 1);
+    }
+
+    // The QR takes the rows of A' (the columns of A) in order of their
+    // first nonzero in the new row order; that way, each one gets rotated
+    // in to a row of R that's mostly still empty.
+    std::vector<std::pair<int, int>> firstRow;
+    for(j = 0; j < n; j++) {
+        if(A.colStart[j] == A.colStart[j + 1]) continue;
+        int first = m;
+        for(p = A.colStart[j]; p < A.colStart[j + 1]; p++) {
+            first = std::min(first, iperm[A.row[p]]);
+        }
+        firstRow.push_back(std::make_pair(first, j));
+    }
+    std::sort(firstRow.begin(), firstRow.end());
+    qrOrder.clear();
+    for(auto &fr : firstRow) {
+        qrOrder.push_back(fr.second);
+    }
+
+    lVal.resize(lStart[m]);
+    d.resize(m);
+    dropped.resize(m);
+    y.assign(m, 0.0);
+    pattern.resize(m);
+}
+
+//-----------------------------------------------------------------------------
+// Factor P*A*A'*P' = L*D*L', a row of L at a time. Row k of A*A' comes
+// straight from the sparse A, and row k of L from a sparse triangular solve
+// against the rows before it. This is Gram-Schmidt on the rows of A, so
+// D[k] is the magnitude squared of what's left of row k once we subtract
+// off its components in the directions of the rows before; if that's no
+// bigger than absTol, or than relTol times the magnitude squared of the
+// whole row, then we call the row dependent on the ones before, and drop
+// it. Returns the number of pivots that we kept, which is the rank. If
+// shift is nonzero, then we factor A*A' + shift*I instead.
+//-----------------------------------------------------------------------------
+int SparseSolver::FactorLdl(const SparseMatrix &A, double absTol, double relTol,
+                            double shift) {
+    int i, k, p, q, top, len;
+    int rank = 0;
+
+    isQr = false;
+    worstPivot = VERY_POSITIVE;
+    flag.assign(m, -1);
+    lCount.assign(m, 0);
+    for(k = 0; k < m; k++) {
+        // Scatter row k of the permuted A*A', up to the diagonal.
+        int r = perm[k];
+        for(p = A.rowStart[r]; p < A.rowStart[r + 1]; p++) {
+            int j = A.col[p];
+            double v = A.num[p];
+            for(q = A.colStart[j]; q < A.colStart[j + 1]; q++) {
+                i = iperm[A.row[q]];
+                if(i > k) continue;
+                y[i] += v*A.num[A.colEntry[q]];
+            }
+        }
+
+        // Find the pattern of row k of L, in topological order.
+        top = m;
+        flag[k] = k;
+        for(p = upStart[k]; p < upStart[k + 1]; p++) {
+            len = 0;
+            for(i = upRow[p]; flag[i] != k; i = parent[i]) {
+                pattern[len++] = i;
+                flag[i] = k;
+            }
+            while(len > 0) pattern[--top] = pattern[--len];
+        }
+
+        y[k] += shift;
+        double diag = y[k];
+        d[k] = y[k];
+        y[k] = 0;
+        for(; top < m; top++) {
+            i = pattern[top];
+            double yi = y[i];
+            y[i] = 0;
+            int pend = lStart[i] + lCount[i];
+            if(lConsecutive[i] && lCount[i] > 0) {
+                // The rows that we've got so far are the first few of
+                // them, so still consecutive.
+                SubtractScaled(&y[lRow[lStart[i]]], &lVal[lStart[i]],
+                               lCount[i], yi);
+            } else {
+                for(p = lStart[i]; p < pend; p++) {
+                    y[lRow[p]] -= lVal[p]*yi;
+                }
+            }
+            // A dropped row gets ignored by everything after it.
+            double lki = dropped[i] ? 0 : yi/d[i];
+            d[k] -= lki*yi;
+            lVal[pend] = lki;
+            lCount[i]++;
+        }
+
+        if(d[k] <= absTol || d[k] <= relTol*diag) {
+            dropped[k] = true;
+        } else {
+            dropped[k] = false;
+            worstPivot = std::min(worstPivot, d[k]/diag);
+            rank++;
+        }
+    }
+    return rank;
+}
+
+//-----------------------------------------------------------------------------
+// Factor P*A*A'*P' = R'*R, where A'*P' = Q*R, by rotating the rows of A' in
+// to R one at a time (George and Heath). R has the same pattern as L', so a
+// row that starts in column k only ever touches rows of R on the path from
+// k to the root of the elimination tree; and once it gets to a row of R
+// that's still empty, it just goes there. This works on A itself instead
+// of on A*A', so it's much less sensitive to a badly conditioned A; the
+// pivots are tested the same way as in the LDL'.
+//-----------------------------------------------------------------------------
+int SparseSolver::FactorQr(const SparseMatrix &A, double absTol, double relTol) {
+    int i, k, p;
+    int rank = 0;
+
+    isQr = true;
+    worstPivot = VERY_POSITIVE;
+    std::fill(lVal.begin(), lVal.end(), 0.0);
+    std::fill(d.begin(), d.end(), 0.0);
+    std::vector<bool> occupied(m, false);
+
+    for(int j : qrOrder) {
+        k = m;
+        for(p = A.colStart[j]; p < A.colStart[j + 1]; p++) {
+            i = iperm[A.row[p]];
+            y[i] = A.num[A.colEntry[p]];
+            k = std::min(k, i);
+        }
+
+        for(; k != -1; k = parent[k]) {
+            int pend = lStart[k + 1];
+            if(!occupied[k]) {
+                occupied[k] = true;
+                d[k] = y[k];
+                y[k] = 0;
+                for(p = lStart[k]; p < pend; p++) {
+                    lVal[p] = y[lRow[p]];
+                    y[lRow[p]] = 0;
+                }
+                break;
+            }
+
+            double wk = y[k];
+            y[k] = 0;
+            if(wk == 0) continue;
+
+            double rk = d[k], h = sqrt(rk*rk + wk*wk);
+            double c = rk/h, s = wk/h;
+            d[k] = h;
+            for(p = lStart[k]; p < pend; p++) {
+                double rv = lVal[p], wv = y[lRow[p]];
+                lVal[p]        =  c*rv + s*wv;
+                y[lRow[p]]     = -s*rv + c*wv;
+            }
+        }
+    }
+
+    for(k = 0; k < m; k++) {
+        int r = perm[k];
+        double diag = 0;
+        for(p = A.rowStart[r]; p < A.rowStart[r + 1]; p++) {
+            diag += A.num[p]*A.num[p];
+        }
+
+        double dk = d[k]*d[k];
+        if(dk <= absTol || dk <= relTol*diag) {
+            dropped[k] = true;
+        } else {
+            dropped[k] = false;
+            worstPivot = std::min(worstPivot, dk/diag);
+            rank++;
+        }
+    }
+    return rank;
+}
+
+// x -= s times column k of L, in the permuted order.
+void SparseSolver::SubtractColumn(int k, double *x, double s) {
+    if(lConsecutive[k]) {
+        SubtractScaled(&x[lRow[lStart[k]]], &lVal[lStart[k]],
+                       lStart[k + 1] - lStart[k], s);
+    } else {
+        for(int p = lStart[k]; p < lStart[k + 1]; p++) {
+            x[lRow[p]] -= lVal[p]*s;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Solve (L*D*L') x = b or (R'*R) x = b in place, in the permuted order. The
+// dropped rows get a zero in the solution, like the rows that Gaussian
+// elimination finds to be singular.
+//-----------------------------------------------------------------------------
+void SparseSolver::SolveFactored(double *x) {
+    int k, p;
+
+    if(isQr) {
+        for(k = 0; k < m; k++) {
+            x[k] = dropped[k] ? 0 : x[k]/d[k];
+            SubtractColumn(k, x, x[k]);
+        }
+        for(k = m - 1; k >= 0; k--) {
+            if(dropped[k]) continue;
+            for(p = lStart[k]; p < lStart[k + 1]; p++) {
+                x[k] -= lVal[p]*x[lRow[p]];
+            }
+            x[k] /= d[k];
+        }
+    } else {
+        for(k = 0; k < m; k++) {
+            SubtractColumn(k, x, x[k]);
+        }
+        for(k = 0; k < m; k++) {
+            x[k] = dropped[k] ? 0 : x[k]/d[k];
+        }
+        for(k = m - 1; k >= 0; k--) {
+            for(p = lStart[k]; p < lStart[k + 1]; p++) {
+                x[k] -= lVal[p]*x[lRow[p]];
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// For a row k that the LDL' dropped, the combination of the rows of A that
+// adds up to zero: row k, less its components along the rows before it,
+// which is row k of L^-1. So solve L' y = e_k; y is nonzero only on rows
+// that come before k, and not on any other dropped row, since nothing
+// after a dropped row refers to it. Writes the nonzeros of y, indexed by
+// the (unpermuted) rows of A.
+//-----------------------------------------------------------------------------
+void SparseSolver::FindDependency(int k, std::vector<std::pair<int, double>> *dep) {
+    ssassert(!isQr && dropped[k], "Expected a row dropped from an LDL'");
+
+    int j, p;
+    std::vector<double> x(k + 1, 0.0);
+    x[k] = 1;
+    for(j = k - 1; j >= 0; j--) {
+        double sum = 0;
+        for(p = lStart[j]; p < lStart[j] + lCount[j]; p++) {
+            if(lRow[p] <= k) sum += lVal[p]*x[lRow[p]];
+        }
+        x[j] = -sum;
+    }
+
+    dep->clear();
+    for(j = 0; j <= k; j++) {
+        if(x[j] != 0) dep->push_back(std::make_pair(perm[j], x[j]));
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Solve (A*A') z = b with the factorization that we have. The seminormal
+// equations from the QR lose some accuracy in forming A*A' implicitly, so
+// in that case we win it back with one step of iterative refinement.
+//-----------------------------------------------------------------------------
+void SparseSolver::Solve(const SparseMatrix &A, double *z, const double *b) {
+    int i, j, k, p;
+
+    std::vector<double> x(m);
+    for(k = 0; k < m; k++) {
+        x[k] = b[perm[k]];
+    }
+    SolveFactored(x.data());
+    for(k = 0; k < m; k++) {
+        z[perm[k]] = x[k];
+    }
+
+    if(!isQr) return;
+
+    int n = A.Cols();
+    t.assign(n, 0.0);
+    for(j = 0; j < n; j++) {
+        for(p = A.colStart[j]; p < A.colStart[j + 1]; p++) {
+            t[j] += A.num[A.colEntry[p]]*z[A.row[p]];
+        }
+    }
+    for(i = 0; i < m; i++) {
+        double res = b[i];
+        for(p = A.rowStart[i]; p < A.rowStart[i + 1]; p++) {
+            res -= A.num[p]*t[A.col[p]];
+        }
+        x[iperm[i]] = res;
+    }
+    SolveFactored(x.data());
+    for(k = 0; k < m; k++) {
+        z[perm[k]] += x[k];
+    }
+}
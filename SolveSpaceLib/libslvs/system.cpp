@@ -19,61 +19,162 @@ const double System::RANK_MAG_TOLERANCE = 1e-4;
 // always be much less than LENGTH_EPS, and in practice should be much less.
 const double System::CONVERGE_TOLERANCE = (LENGTH_EPS/(1e2));
 
-bool System::WriteJacobian(int tag) {
-    int a, i, j;
-
-    j = 0;
+// In the least squares solve, a row of the Jacobian that's this close to
+// dependent on the rows before it (as the magnitude squared of what's left
+// of it, relative to the whole row) is dropped, like a singular pivot in
+// Gaussian elimination.
+const double System::PIVOT_TOLERANCE = 1e-14;
+
+// And if the worst pivot that we keep is this small, then we've lost too
+// many digits to the normal equations, and should factor A itself instead.
+const double System::ILL_CONDITIONED = 1e-8;
+
+// A Jacobian this big takes long enough to evaluate (about a millisecond)
+// that it's worth waking the thread pool for, in chunks big enough that
+// handing them out costs little.
+const int System::DEFAULT_PARALLEL_ROWS = 4096;
+const int System::PARALLEL_CHUNK_ROWS   = 256;
+
+void System::WriteJacobian(int tag) {
+    double startTime = GetSeconds();
+    int a, i, j, k;
+
+    // The column that each param gets in the Jacobian, or -1 if it's not
+    // one of the unknowns that we're solving for.
+    std::vector<int> paramCol(param.n, -1);
+
+    mat.param.clear();
     for(a = 0; a < param.n; a++) {
-        if(j >= MAX_UNKNOWNS) return false;
-
         Param *p = &(param.elem[a]);
         if(p->tag != tag) continue;
-        mat.param[j] = p->h;
-        j++;
+        paramCol[a] = (int)mat.param.size();
+        mat.param.push_back(p->h);
     }
-    mat.n = j;
+    mat.n = (int)mat.param.size();
 
-    i = 0;
-    for(a = 0; a < eq.n; a++) {
-        if(i >= MAX_UNKNOWNS) return false;
+    mat.A.rowStart.clear();
+    mat.A.col.clear();
+    mat.A.wrt.clear();
+    mat.A.rowStart.push_back(0);
+
+    mat.eq.clear();
+    mat.B.tape.Clear();
 
+    ExprTape *tape = &mat.B.tape;
+    std::vector<std::pair<int, int>> entries;
+
+    for(a = 0; a < eq.n; a++) {
         Equation *e = &(eq.elem[a]);
         if(e->tag != tag) continue;
 
-        mat.eq[i] = e->h;
+        mat.eq.push_back(e->h);
         Expr *f = e->e->DeepCopyWithParamsAsPointers(&param, &(SK.param));
         f = f->FoldConstants();
+        int r = tape->Add(f);
+
+        // We'll differentiate the tape, so the partial with respect to any
+        // unknown that the equation refers to gets an entry, and the others
+        // are zero.
+        entries.clear();
+        for(k = tape->usedStart[r]; k < tape->usedStart[r + 1]; k++) {
+            int reg = tape->used[k];
+            Param *p = tape->slotParam[tape->code[reg].a];
+            if(p < param.elem || p >= param.elem + param.n) continue;
+            int c = paramCol[p - param.elem];
+            if(c >= 0) entries.emplace_back(c, reg);
+        }
+        std::sort(entries.begin(), entries.end());
 
-        // Hash table (61 bits) to accelerate generation of zero partials.
-        uint64_t scoreboard = f->ParamsUsed();
-        for(j = 0; j < mat.n; j++) {
-            Expr *pd;
-            if(scoreboard & ((uint64_t)1 << (mat.param[j].v % 61)) &&
-                f->DependsOn(mat.param[j]))
-            {
-                pd = f->PartialWrt(mat.param[j]);
-                pd = pd->FoldConstants();
-                pd = pd->DeepCopyWithParamsAsPointers(&param, &(SK.param));
-            } else {
-                pd = Expr::From(0.0);
-            }
-            mat.A.sym[i][j] = pd;
+        for(auto &en : entries) {
+            mat.A.col.push_back(en.first);
+            mat.A.wrt.push_back(en.second);
+        }
+        mat.A.rowStart.push_back((int)mat.A.col.size());
+    }
+    mat.m = (int)mat.eq.size();
+
+    int nnz = (int)mat.A.col.size();
+    mat.A.num.assign(nnz, 0.0);
+    mat.B.num.assign(mat.m, 0.0);
+    mat.rankFactored = false;
+    mat.scale.assign(mat.n, 1.0);
+    mat.X.assign(mat.n, 0.0);
+    mat.Z.assign(mat.m, 0.0);
+
+    // And index the same entries by column; a counting sort, where we visit
+    // the rows in order so that each column comes out sorted by row.
+    mat.A.colStart.assign(mat.n + 1, 0);
+    for(k = 0; k < nnz; k++) {
+        mat.A.colStart[mat.A.col[k] + 1]++;
+    }
+    for(j = 0; j < mat.n; j++) {
+        mat.A.colStart[j + 1] += mat.A.colStart[j];
+    }
+    mat.A.row.resize(nnz);
+    mat.A.colEntry.resize(nnz);
+    std::vector<int> next(mat.A.colStart.begin(), mat.A.colStart.end() - 1);
+    for(i = 0; i < mat.m; i++) {
+        for(k = mat.A.rowStart[i]; k < mat.A.rowStart[i + 1]; k++) {
+            int dest = next[mat.A.col[k]]++;
+            mat.A.row[dest] = i;
+            mat.A.colEntry[dest] = k;
         }
-        mat.B.sym[i] = f;
-        i++;
     }
-    mat.m = i;
 
-    return true;
+    stats.jacobianTime += GetSeconds() - startTime;
+}
+
+bool System::EvalInParallel() {
+    int rows = (parallelRows == 0) ? DEFAULT_PARALLEL_ROWS : parallelRows;
+    return rows >= 0 && mat.m >= rows;
 }
 
 void System::EvalJacobian() {
-    int i, j;
-    for(i = 0; i < mat.m; i++) {
-        for(j = 0; j < mat.n; j++) {
-            mat.A.num[i][j] = (mat.A.sym[i][j])->Eval();
+    double startTime = GetSeconds();
+    mat.rankFactored = false;
+    ExprTape *tape = &(mat.B.tape);
+    auto partials = [&](int first, int last) {
+        for(int i = first; i < last; i++) {
+            int k = mat.A.rowStart[i];
+            tape->Partials(i, mat.A.wrt.data() + k, mat.A.rowStart[i + 1] - k,
+                           mat.A.num.data() + k);
         }
+    };
+
+    if(EvalInParallel()) {
+        // Each row comes out the same whichever thread does it, so this
+        // gives the same answer as below.
+        tape->LoadParams();
+        int chunks = (mat.m + PARALLEL_CHUNK_ROWS - 1)/PARALLEL_CHUNK_ROWS;
+        ParallelFor(chunks, [&](int c) {
+            int first = c*PARALLEL_CHUNK_ROWS,
+                last  = std::min(mat.m, first + PARALLEL_CHUNK_ROWS);
+            tape->EvalRange(first, last, mat.B.num.data());
+            partials(first, last);
+        });
+    } else {
+        // A forward pass for the values, then a backward one for each row.
+        tape->Eval(mat.B.num.data());
+        partials(0, mat.m);
+    }
+    stats.evalTime += GetSeconds() - startTime;
+}
+
+void System::EvalResiduals() {
+    double startTime = GetSeconds();
+    ExprTape *tape = &(mat.B.tape);
+    if(EvalInParallel()) {
+        tape->LoadParams();
+        int chunks = (mat.m + PARALLEL_CHUNK_ROWS - 1)/PARALLEL_CHUNK_ROWS;
+        ParallelFor(chunks, [&](int c) {
+            int first = c*PARALLEL_CHUNK_ROWS;
+            tape->EvalRange(first, std::min(mat.m, first + PARALLEL_CHUNK_ROWS),
+                            mat.B.num.data());
+        });
+    } else {
+        tape->Eval(mat.B.num.data());
     }
+    stats.evalTime += GetSeconds() - startTime;
 }
 
 bool System::IsDragged(hParam p) {
@@ -85,7 +186,29 @@ bool System::IsDragged(hParam p) {
 }
 
 void System::SolveBySubstitution() {
+    double startTime = GetSeconds();
+
+    // Each equation that sets two params equal substitutes one for the
+    // other, so the params that are equal form trees, in which each one
+    // points at the param that replaced it and the root is the one that's
+    // left. Find those first, by index in to param, and then rewrite the
+    // equations just once, instead of once for each substitution.
+    std::vector<int> parent(param.n);
     int i;
+    for(i = 0; i < param.n; i++) {
+        parent[i] = i;
+    }
+    auto root = [&](int k) {
+        int r = k;
+        while(parent[r] != r) r = parent[r];
+        while(parent[k] != r) {
+            int next = parent[k];
+            parent[k] = r;
+            k = next;
+        }
+        return r;
+    };
+
     for(i = 0; i < eq.n; i++) {
         Equation *teq = &(eq.elem[i]);
         Expr *tex = teq->e;
@@ -94,147 +217,423 @@ void System::SolveBySubstitution() {
            tex->a->op == Expr::Op::PARAM &&
            tex->b->op == Expr::Op::PARAM)
         {
-            hParam a = tex->a->parh;
-            hParam b = tex->b->parh;
-            if(!(param.FindByIdNoOops(a) && param.FindByIdNoOops(b))) {
+            int a = param.IndexOf(tex->a->parh);
+            int b = param.IndexOf(tex->b->parh);
+            if(a < 0 || b < 0) {
                 // Don't substitute unless they're both solver params;
                 // otherwise it's an equation that can be solved immediately,
                 // or an error to flag later.
                 continue;
             }
+            // The params that this equation refers to, once the equations
+            // before it have been substituted.
+            a = root(a);
+            b = root(b);
 
-            if(IsDragged(a)) {
+            if(IsDragged(param.elem[a].h)) {
                 // A is being dragged, so A should stay, and B should go
-                hParam t = a;
-                a = b;
-                b = t;
+                swap(a, b);
             }
 
-            int j;
-            for(j = 0; j < eq.n; j++) {
-                Equation *req = &(eq.elem[j]);
-                (req->e)->Substitute(a, b); // A becomes B, B unchanged
-            }
-            for(j = 0; j < param.n; j++) {
-                Param *rp = &(param.elem[j]);
-                if(rp->substd.v == a.v) {
-                    rp->substd = b;
-                }
-            }
-            Param *ptr = param.FindById(a);
-            ptr->tag = VAR_SUBSTITUTED;
-            ptr->substd = b;
+            parent[a] = b; // A becomes B, B unchanged
+            param.elem[a].tag = VAR_SUBSTITUTED;
 
             teq->tag = EQ_SUBSTITUTED;
         }
     }
+
+    for(i = 0; i < param.n; i++) {
+        Param *p = &(param.elem[i]);
+        if(p->tag == VAR_SUBSTITUTED) p->substd = param.elem[root(i)].h;
+    }
+    for(i = 0; i < eq.n; i++) {
+        eq.elem[i].e->Substitute(&param);
+    }
+
+    stats.substituteTime += GetSeconds() - startTime;
+}
+
+// Find the params that an expression refers to by handle, which is how the
+// equations refer to them before we write the Jacobian.
+static void ParamHandlesUsed(const Expr *e, std::vector<hParam> *used) {
+    if(e->op == Expr::Op::PARAM) {
+        used->push_back(e->parh);
+        return;
+    }
+    int c = e->Children();
+    if(c >= 1) ParamHandlesUsed(e->a, used);
+    if(c >= 2) ParamHandlesUsed(e->b, used);
+}
+
+static int FindRoot(std::vector<int> *up, int i) {
+    while((*up)[i] != i) {
+        (*up)[i] = (*up)[(*up)[i]];
+        i = (*up)[i];
+    }
+    return i;
 }
 
 //-----------------------------------------------------------------------------
-// Calculate the rank of the Jacobian matrix, by Gram-Schimdt orthogonalization
-// in place. A row (~equation) is considered to be all zeros if its magnitude
-// is less than the tolerance RANK_MAG_TOLERANCE.
+// Split the equations and unknowns that are left to solve (those with tag
+// zero) in to parts that we can solve independently, since they don't share
+// any unknowns. Each part gets a System of its own, with its equations and
+// unknowns, and also the known params that its equations refer to, which
+// keep their (nonzero) tags. An equation that refers to no unknowns at all
+// is a part by itself. If everything is connected, then we leave parts
+// empty, since that part would just be a copy of this system. Returns the
+// number of unknowns that no equation refers to.
 //-----------------------------------------------------------------------------
-int System::CalculateRank() {
-    // Actually work with magnitudes squared, not the magnitudes
-    double rowMag[MAX_UNKNOWNS] = {};
-    double tol = RANK_MAG_TOLERANCE*RANK_MAG_TOLERANCE;
+int System::SplitInToParts(std::vector<System> *parts) {
+    int a, j, k;
 
-    int i, iprev, j;
-    int rank = 0;
+    // Union-find over the unknowns, joining all those used by an equation.
+    std::vector<int> up(param.n);
+    for(j = 0; j < param.n; j++) {
+        up[j] = j;
+    }
+    // And the params that each equation uses, by index in to param.
+    std::vector<int> usedStart(eq.n + 1, 0), used;
+    std::vector<hParam> handles;
+    for(a = 0; a < eq.n; a++) {
+        Equation *e = &(eq.elem[a]);
+        if(e->tag == 0) {
+            handles.clear();
+            ParamHandlesUsed(e->e, &handles);
+            int first = -1;
+            for(hParam hp : handles) {
+                j = param.IndexOf(hp);
+                // Params that aren't ours come from the sketch, and are known.
+                if(j < 0) continue;
+                used.push_back(j);
+                if(param.elem[j].tag != 0) continue;
+
+                if(first < 0) {
+                    first = j;
+                } else {
+                    up[FindRoot(&up, j)] = FindRoot(&up, first);
+                }
+            }
+        }
+        usedStart[a + 1] = (int)used.size();
+    }
 
-    for(i = 0; i < mat.m; i++) {
-        // Subtract off this row's component in the direction of any
-        // previous rows
-        for(iprev = 0; iprev < i; iprev++) {
-            if(rowMag[iprev] <= tol) continue; // ignore zero rows
+    // Number the parts, in the order of their first equations.
+    std::vector<int> eqPart(eq.n, -1), paramPart(param.n, -1);
+    int count = 0;
+    for(a = 0; a < eq.n; a++) {
+        if(eq.elem[a].tag != 0) continue;
 
-            double dot = 0;
-            for(j = 0; j < mat.n; j++) {
-                dot += (mat.A.num[iprev][j]) * (mat.A.num[i][j]);
-            }
-            for(j = 0; j < mat.n; j++) {
-                mat.A.num[i][j] -= (dot/rowMag[iprev])*mat.A.num[iprev][j];
+        int root = -1;
+        for(k = usedStart[a]; k < usedStart[a + 1]; k++) {
+            if(param.elem[used[k]].tag == 0) {
+                root = FindRoot(&up, used[k]);
+                break;
             }
         }
-        // Our row is now normal to all previous rows; calculate the
-        // magnitude of what's left
-        double mag = 0;
-        for(j = 0; j < mat.n; j++) {
-            mag += (mat.A.num[i][j]) * (mat.A.num[i][j]);
+        if(root < 0) {
+            eqPart[a] = count++;
+        } else {
+            if(paramPart[root] < 0) paramPart[root] = count++;
+            eqPart[a] = paramPart[root];
         }
-        if(mag > tol) {
-            rank++;
+    }
+
+    int unreferenced = 0;
+    std::vector<std::vector<int>> partParams(count);
+    for(j = 0; j < param.n; j++) {
+        if(param.elem[j].tag != 0) continue;
+        int part = paramPart[FindRoot(&up, j)];
+        if(part < 0) {
+            unreferenced++;
+        } else {
+            partParams[part].push_back(j);
         }
-        rowMag[i] = mag;
     }
 
-    return rank;
-}
+    parts->clear();
+    if(count <= 1) return unreferenced;
 
-bool System::TestRank() {
-    EvalJacobian();
-    return CalculateRank() == mat.m;
+    for(a = 0; a < eq.n; a++) {
+        if(eqPart[a] < 0) continue;
+        for(k = usedStart[a]; k < usedStart[a + 1]; k++) {
+            j = used[k];
+            if(param.elem[j].tag != 0) partParams[eqPart[a]].push_back(j);
+        }
+    }
+
+    parts->resize(count);
+    for(int i = 0; i < count; i++) {
+        System *part = &((*parts)[i]);
+        part->backend      = backend;
+        part->method       = method;
+        part->parallelRows = parallelRows;
+        for(hParam &hp : dragged) {
+            part->dragged.Add(&hp);
+        }
+
+        // In order, so that each Add() goes on the end.
+        std::vector<int> *pp = &(partParams[i]);
+        std::sort(pp->begin(), pp->end());
+        pp->erase(std::unique(pp->begin(), pp->end()), pp->end());
+        for(int pj : *pp) {
+            part->param.Add(&(param.elem[pj]));
+        }
+    }
+    for(a = 0; a < eq.n; a++) {
+        if(eqPart[a] < 0) continue;
+        (*parts)[eqPart[a]].eq.Add(&(eq.elem[a]));
+    }
+    return unreferenced;
 }
 
-bool System::SolveLinearSystem(double X[], double A[][MAX_UNKNOWNS],
-                               double B[], int n)
-{
-    // Gaussian elimination, with partial pivoting. It's an error if the
-    // matrix is singular, because that means two constraints are
-    // equivalent.
-    int i, j, ip, jp, imax = 0;
-    double max, temp;
+//-----------------------------------------------------------------------------
+// Find how the equations constrain the unknowns from which unknowns each one
+// refers to, without evaluating anything. A maximum matching (by Hopcroft-
+// Karp) pairs up as many equations as it can, each with an unknown of its
+// own; an unknown that's left over is a degree of freedom, and an equation
+// that's left over is redundant. Then the Dulmage-Mendelsohn decomposition:
+// whatever an alternating path reaches from a left over equation is over-
+// constrained, and whatever one reaches from a left over unknown is under-
+// constrained. That's exact for generic values of the params. The Jacobian
+// can only have lower rank, so the solve finds at least these redundancies,
+// and at least these degrees of freedom.
+//-----------------------------------------------------------------------------
+void System::AnalyzeStructure(Group *g, Structure *s, List<hConstraint> *bad) {
+    int a, i, j, k;
+
+    WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+    int m = eq.n, n = param.n;
+
+    // The unknowns that each equation refers to, and the equations that
+    // refer to each unknown.
+    std::vector<int> adjStart(m + 1, 0), adj;
+    std::vector<hParam> handles;
+    for(i = 0; i < m; i++) {
+        handles.clear();
+        ParamHandlesUsed(eq.elem[i].e, &handles);
+        for(hParam hp : handles) {
+            j = param.IndexOf(hp);
+            if(j >= 0) adj.push_back(j);
+        }
+        std::sort(adj.begin() + adjStart[i], adj.end());
+        adj.erase(std::unique(adj.begin() + adjStart[i], adj.end()), adj.end());
+        adjStart[i + 1] = (int)adj.size();
+    }
+    std::vector<int> refStart(n + 1, 0), ref(adj.size());
+    for(int c : adj) {
+        refStart[c + 1]++;
+    }
+    for(j = 0; j < n; j++) {
+        refStart[j + 1] += refStart[j];
+    }
+    std::vector<int> next(refStart.begin(), refStart.end() - 1);
+    for(i = 0; i < m; i++) {
+        for(k = adjStart[i]; k < adjStart[i + 1]; k++) {
+            ref[next[adj[k]]++] = i;
+        }
+    }
+
+    // Start from a greedy matching, which usually gets most of the way.
+    std::vector<int> eqMate(m, -1), paramMate(n, -1);
+    for(i = 0; i < m; i++) {
+        for(k = adjStart[i]; k < adjStart[i + 1]; k++) {
+            if(paramMate[adj[k]] >= 0) continue;
+            eqMate[i] = adj[k];
+            paramMate[adj[k]] = i;
+            break;
+        }
+    }
 
-    for(i = 0; i < n; i++) {
-        // We are trying eliminate the term in column i, for rows i+1 and
-        // greater. First, find a pivot (between rows i and N-1).
-        max = 0;
-        for(ip = i; ip < n; ip++) {
-            if(ffabs(A[ip][i]) > max) {
-                imax = ip;
-                max = ffabs(A[ip][i]);
+    // Then each phase finds the shortest augmenting paths by a breadth-first
+    // search from the unmatched equations, and augments along as many of
+    // them as a depth-first search down those layers finds.
+    const int UNREACHED = INT_MAX;
+    std::vector<int> layer(m), queue, path, edge(m);
+    for(;;) {
+        queue.clear();
+        for(i = 0; i < m; i++) {
+            if(eqMate[i] < 0) {
+                layer[i] = 0;
+                queue.push_back(i);
+            } else {
+                layer[i] = UNREACHED;
             }
         }
-        // Don't give up on a singular matrix unless it's really bad; the
-        // assumption code is responsible for identifying that condition,
-        // so we're not responsible for reporting that error.
-        if(ffabs(max) < 1e-20) continue;
+        bool augmentable = false;
+        for(size_t q = 0; q < queue.size(); q++) {
+            i = queue[q];
+            for(k = adjStart[i]; k < adjStart[i + 1]; k++) {
+                int mate = paramMate[adj[k]];
+                if(mate < 0) {
+                    augmentable = true;
+                } else if(layer[mate] == UNREACHED) {
+                    layer[mate] = layer[i] + 1;
+                    queue.push_back(mate);
+                }
+            }
+        }
+        if(!augmentable) break;
 
-        // Swap row imax with row i
-        for(jp = 0; jp < n; jp++) {
-            swap(A[i][jp], A[imax][jp]);
+        for(i = 0; i < m; i++) {
+            edge[i] = adjStart[i];
         }
-        swap(B[i], B[imax]);
+        for(int root = 0; root < m; root++) {
+            if(eqMate[root] >= 0) continue;
+            path.clear();
+            path.push_back(root);
+            while(!path.empty()) {
+                i = path.back();
+                if(edge[i] == adjStart[i + 1]) {
+                    // A dead end, so don't come this way again.
+                    layer[i] = UNREACHED;
+                    path.pop_back();
+                    continue;
+                }
+                int mate = paramMate[adj[edge[i]]];
+                if(mate < 0) {
+                    // Each equation on the path takes the unknown that it
+                    // went to next, from the equation after it.
+                    for(int e : path) {
+                        j = adj[edge[e]];
+                        eqMate[e] = j;
+                        paramMate[j] = e;
+                    }
+                    break;
+                }
+                if(layer[mate] == layer[i] + 1) {
+                    path.push_back(mate);
+                } else {
+                    edge[i]++;
+                }
+            }
+        }
+    }
 
-        // For rows i+1 and greater, eliminate the term in column i.
-        for(ip = i+1; ip < n; ip++) {
-            temp = A[ip][i]/A[i][i];
+    // The over-constrained part: from each equation left over, to all the
+    // unknowns that it refers to, and then on to the equations that those
+    // are matched to, which must exist, or the matching wasn't maximum.
+    std::vector<bool> overEq(m, false), overParam(n, false);
+    queue.clear();
+    for(i = 0; i < m; i++) {
+        if(eqMate[i] >= 0) continue;
+        overEq[i] = true;
+        queue.push_back(i);
+    }
+    for(size_t q = 0; q < queue.size(); q++) {
+        i = queue[q];
+        for(k = adjStart[i]; k < adjStart[i + 1]; k++) {
+            j = adj[k];
+            if(overParam[j]) continue;
+            overParam[j] = true;
+            if(!overEq[paramMate[j]]) {
+                overEq[paramMate[j]] = true;
+                queue.push_back(paramMate[j]);
+            }
+        }
+    }
 
-            for(jp = i; jp < n; jp++) {
-                A[ip][jp] -= temp*(A[i][jp]);
+    // And the under-constrained part, the same way from each unknown left
+    // over.
+    std::vector<bool> underEq(m, false), underParam(n, false);
+    queue.clear();
+    for(j = 0; j < n; j++) {
+        if(paramMate[j] >= 0) continue;
+        underParam[j] = true;
+        queue.push_back(j);
+    }
+    for(size_t q = 0; q < queue.size(); q++) {
+        j = queue[q];
+        for(k = refStart[j]; k < refStart[j + 1]; k++) {
+            i = ref[k];
+            if(underEq[i]) continue;
+            underEq[i] = true;
+            if(!underParam[eqMate[i]]) {
+                underParam[eqMate[i]] = true;
+                queue.push_back(eqMate[i]);
             }
-            B[ip] -= temp*B[i];
         }
     }
 
-    // We've put the matrix in upper triangular form, so at this point we
-    // can solve by back-substitution.
-    for(i = n - 1; i >= 0; i--) {
-        if(ffabs(A[i][i]) < 1e-20) continue;
+    *s = {};
+    s->unknowns  = n;
+    s->equations = m;
+    for(i = 0; i < m; i++) {
+        if(eqMate[i] >= 0) s->matched++;
+        if(overEq[i])      s->overEquations++;
+        if(underEq[i])     s->underEquations++;
+    }
+    for(j = 0; j < n; j++) {
+        if(overParam[j])   s->overUnknowns++;
+        if(underParam[j])  s->underUnknowns++;
+    }
 
-        temp = B[i];
-        for(j = n - 1; j > i; j--) {
-            temp -= X[j]*A[i][j];
+    // Report the constraints in the over-constrained part, in the same order
+    // as FindWhichToRemoveToFixJacobian() would.
+    std::vector<uint32_t> over;
+    for(i = 0; i < m; i++) {
+        if(!overEq[i] || !eq.elem[i].h.isFromConstraint()) continue;
+        over.push_back(eq.elem[i].h.constraint().v);
+    }
+    std::sort(over.begin(), over.end());
+    for(a = 0; a < 2; a++) {
+        for(i = 0; i < SK.constraint.n; i++) {
+            ConstraintBase *c = &(SK.constraint.elem[i]);
+            if(c->group.v != g->h.v) continue;
+            if((c->type == Constraint::Type::POINTS_COINCIDENT) != (a == 1)) {
+                continue;
+            }
+            if(std::binary_search(over.begin(), over.end(), c->h.v)) {
+                bad->Add(&(c->h));
+            }
         }
-        X[i] = temp / A[i][i];
     }
+}
 
-    return true;
+//-----------------------------------------------------------------------------
+// Calculate the rank of the Jacobian matrix. This is Gram-Schmidt
+// orthogonalization of the rows, but worked on A*A' instead of on A itself,
+// since that's cheap to get from the sparse A; in an LDL' factorization of
+// A*A', D[i] is the magnitude squared of what's left of row i after we
+// subtract off its component in the direction of any previous rows. A row
+// (~equation) is considered to be all zeros if its magnitude is less than
+// the tolerance RANK_MAG_TOLERANCE. If the rank is full, and no pivot
+// is small enough that the least squares solve would drop it or go to the
+// QR, then this is also the factor that the next Newton step needs.
+//-----------------------------------------------------------------------------
+int System::CalculateRank() {
+    double startTime = GetSeconds();
+
+    // Actually work with magnitudes squared, not the magnitudes
+    double tol = RANK_MAG_TOLERANCE*RANK_MAG_TOLERANCE;
+
+    int rank;
+    if(UseDenseBackend()) {
+        rank = CalculateRankDense();
+    } else {
+        mat.factor.Analyze(mat.A);
+        rank = mat.factor.FactorLdl(mat.A, tol, 0);
+        mat.rankFactored = (rank == mat.m &&
+                            mat.factor.worstPivot >= ILL_CONDITIONED);
+    }
+
+    stats.rankTime += GetSeconds() - startTime;
+    return rank;
+}
+
+bool System::TestRank() {
+    EvalJacobian();
+    return CalculateRank() == mat.m;
 }
 
-bool System::SolveLeastSquares() {
-    int r, c, i;
+// Solve for the least squares step; or, if damping is nonzero, for the
+// Levenberg-Marquardt step, which is the least squares step for A*A' plus
+// damping times the identity.
+bool System::SolveLeastSquares(double damping) {
+    double startTime = GetSeconds();
+    int c, i;
+    size_t k;
+    bool reuse = mat.rankFactored && damping == 0;
+    mat.rankFactored = false;
 
     // Scale the columns; this scale weights the parameters for the least
     // squares solve, so that we can encourage the solver to make bigger
@@ -244,51 +643,62 @@ bool System::SolveLeastSquares() {
             // It's least squares, so this parameter doesn't need to be all
             // that big to get a large effect.
             mat.scale[c] = 1/20.0;
+            reuse = false;
         } else {
             mat.scale[c] = 1;
         }
-        for(r = 0; r < mat.m; r++) {
-            mat.A.num[r][c] *= mat.scale[c];
-        }
     }
+    for(k = 0; k < mat.A.num.size(); k++) {
+        mat.A.num[k] *= mat.scale[mat.A.col[k]];
+    }
+
+    // The dense backend gives up on a rank-deficient system, which the
+    // sparse one can deal with.
+    if(!(UseDenseBackend() && SolveLeastSquaresDense(damping))) {
+        // Solve (A*A')Z = B; the pattern of A is usually the same as last
+        // time, so the symbolic work is usually already done. The damping
+        // keeps the pivots away from zero, so then we don't need the QR.
+        // Unless the rank test already factored this same A.
+        if(!reuse) {
+            mat.factor.Analyze(mat.A);
+            mat.factor.FactorLdl(mat.A, 1e-20, PIVOT_TOLERANCE, damping);
+            if(mat.factor.worstPivot < ILL_CONDITIONED && damping == 0) {
+                mat.factor.FactorQr(mat.A, 1e-20, PIVOT_TOLERANCE);
+            }
+        }
+        mat.factor.Solve(mat.A, mat.Z.data(), mat.B.num.data());
 
-    // Write A*A'
-    for(r = 0; r < mat.m; r++) {
-        for(c = 0; c < mat.m; c++) {  // yes, AAt is square
+        // And multiply that by A' to get our solution.
+        for(c = 0; c < mat.n; c++) {
             double sum = 0;
-            for(i = 0; i < mat.n; i++) {
-                sum += mat.A.num[r][i]*mat.A.num[c][i];
+            for(i = mat.A.colStart[c]; i < mat.A.colStart[c + 1]; i++) {
+                sum += mat.A.num[mat.A.colEntry[i]]*mat.Z[mat.A.row[i]];
             }
-            mat.AAt[r][c] = sum;
+            mat.X[c] = sum;
         }
     }
-
-    if(!SolveLinearSystem(mat.Z, mat.AAt, mat.B.num, mat.m)) return false;
-
-    // And multiply that by A' to get our solution.
     for(c = 0; c < mat.n; c++) {
-        double sum = 0;
-        for(i = 0; i < mat.m; i++) {
-            sum += mat.A.num[i][c]*mat.Z[i];
-        }
-        mat.X[c] = sum * mat.scale[c];
+        mat.X[c] *= mat.scale[c];
     }
+    stats.solveTime += GetSeconds() - startTime;
     return true;
 }
 
 bool System::NewtonSolve(int tag) {
+    if(method == Method::LEVENBERG_MARQUARDT) return SolveLevenbergMarquardt();
 
     int iter = 0;
     bool converged = false;
     int i;
 
     // Evaluate the functions at our operating point.
-    for(i = 0; i < mat.m; i++) {
-        mat.B.num[i] = (mat.B.sym[i])->Eval();
-    }
+    EvalResiduals();
     do {
-        // And evaluate the Jacobian at our initial operating point.
-        EvalJacobian();
+        stats.iterations++;
+
+        // And evaluate the Jacobian at our initial operating point, unless
+        // the rank test just did.
+        if(!mat.rankFactored) EvalJacobian();
 
         if(!SolveLeastSquares()) break;
 
@@ -304,9 +714,7 @@ bool System::NewtonSolve(int tag) {
         }
 
         // Re-evalute the functions, since the params have just changed.
-        for(i = 0; i < mat.m; i++) {
-            mat.B.num[i] = (mat.B.sym[i])->Eval();
-        }
+        EvalResiduals();
         // Check for convergence
         converged = true;
         for(i = 0; i < mat.m; i++) {
@@ -323,6 +731,152 @@ bool System::NewtonSolve(int tag) {
     return converged;
 }
 
+//-----------------------------------------------------------------------------
+// Get a better place to start Newton's method from, when we solve the same
+// system as last time from nearby. First move the unknowns by their guessed
+// changes, or rather by the part of those that changes the residuals,
+// A'*(A*A')^-1*A times the guess; the rest is along the constraints, where
+// Newton's method never moves us, so taking it would change where we end up
+// and not just how fast we get there. Then take a Newton step, but with the
+// same A. That A and the factor of A*A' are from the rank test after the
+// last solve, so all this costs no new Jacobian and no new factorization;
+// the caller has to make sure that the last solve converged, and that's
+// what they are.
+//-----------------------------------------------------------------------------
+void System::StartFromGuess() {
+    int i, c, k;
+    bool any = false;
+    std::vector<double> dx(mat.n);
+    for(c = 0; c < mat.n; c++) {
+        // The factor is of the unscaled A*A', so it can't weight the
+        // dragged params like SolveLeastSquares() does.
+        if(IsDragged(mat.param[c])) return;
+        dx[c] = param.FindById(mat.param[c])->guess;
+        if(dx[c] != 0) any = true;
+    }
+    // The dense backend's rank test doesn't leave a factor.
+    if(!any || UseDenseBackend()) return;
+
+    double startTime = GetSeconds();
+    std::vector<double> r(mat.m), z(mat.m);
+    for(i = 0; i < mat.m; i++) {
+        double sum = 0;
+        for(k = mat.A.rowStart[i]; k < mat.A.rowStart[i + 1]; k++) {
+            sum += mat.A.num[k]*dx[mat.A.col[k]];
+        }
+        r[i] = sum;
+    }
+    mat.factor.Solve(mat.A, z.data(), r.data());
+    for(c = 0; c < mat.n; c++) {
+        double sum = 0;
+        for(k = mat.A.colStart[c]; k < mat.A.colStart[c + 1]; k++) {
+            sum += mat.A.num[mat.A.colEntry[k]]*z[mat.A.row[k]];
+        }
+        param.FindById(mat.param[c])->val += sum;
+    }
+
+    EvalResiduals();
+    mat.factor.Solve(mat.A, z.data(), mat.B.num.data());
+    for(c = 0; c < mat.n; c++) {
+        double sum = 0;
+        for(k = mat.A.colStart[c]; k < mat.A.colStart[c + 1]; k++) {
+            sum += mat.A.num[mat.A.colEntry[k]]*z[mat.A.row[k]];
+        }
+        param.FindById(mat.param[c])->val -= sum;
+    }
+    stats.solveTime += GetSeconds() - startTime;
+}
+
+bool System::ResidualsConverged() {
+    for(int i = 0; i < mat.m; i++) {
+        if(ffabs(mat.B.num[i]) > CONVERGE_TOLERANCE) return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Like NewtonSolve(), but each step solves (A*A' + mu*I)Z = B instead, which
+// is a Newton step when mu is zero and a short step downhill in the sum of
+// the squares of the residuals when it's big. We compare how much each step
+// reduces that sum with how much the linearization said it would, and take
+// a smaller (more damped) step if it didn't help, or a bigger one if it
+// did, following Nielsen. We start with full Newton steps, since those are
+// fastest when they work, and damp only once one of them fails to help;
+// that converges from starting points where Newton overshoots and diverges.
+//-----------------------------------------------------------------------------
+bool System::SolveLevenbergMarquardt() {
+    int iter = 0, i;
+    double mu = 0, nu = 2;
+    std::vector<double> old(mat.n);
+
+    EvalResiduals();
+    double cost = 0;
+    for(i = 0; i < mat.m; i++) {
+        cost += mat.B.num[i]*mat.B.num[i];
+    }
+    if(isnan(cost)) return false;
+    if(ResidualsConverged()) return true;
+
+    do {
+        stats.iterations++;
+
+        if(!mat.rankFactored) EvalJacobian();
+        if(!SolveLeastSquares(mu)) break;
+
+        for(i = 0; i < mat.n; i++) {
+            Param *p = param.FindById(mat.param[i]);
+            old[i] = p->val;
+            p->val -= mat.X[i];
+        }
+
+        // The linearization leaves a residual of mu*Z, so this is how much
+        // it says that the step will reduce the sum of squares.
+        double predicted = cost;
+        for(i = 0; i < mat.m; i++) {
+            predicted -= mu*mu*mat.Z[i]*mat.Z[i];
+        }
+
+        EvalResiduals();
+        double newCost = 0;
+        for(i = 0; i < mat.m; i++) {
+            newCost += mat.B.num[i]*mat.B.num[i];
+        }
+
+        double rho = (predicted > 0) ? (cost - newCost)/predicted : -1;
+        if(!isnan(newCost) && rho > 0) {
+            cost = newCost;
+            if(ResidualsConverged()) return true;
+            mu *= std::max(1/3.0, 1 - pow(2*rho - 1, 3));
+            nu = 2;
+        } else {
+            // Worse than where we started, so go back and damp more.
+            for(i = 0; i < mat.n; i++) {
+                param.FindById(mat.param[i])->val = old[i];
+            }
+            if(mu == 0) {
+                // Start small relative to the biggest diagonal of (the
+                // scaled) A*A'.
+                double biggest = 0;
+                for(i = 0; i < mat.m; i++) {
+                    double rowSum = 0;
+                    for(int k = mat.A.rowStart[i]; k < mat.A.rowStart[i + 1]; k++) {
+                        rowSum += mat.A.num[k]*mat.A.num[k];
+                    }
+                    biggest = std::max(biggest, rowSum);
+                }
+                mu = 1e-3*std::max(biggest, 1e-10);
+            } else {
+                mu *= nu;
+                nu *= 2;
+            }
+        }
+    } while(iter++ < 50);
+
+    // Leave the residuals for where we ended up, to report the bad ones.
+    EvalResiduals();
+    return false;
+}
+
 void System::WriteEquationsExceptFor(hConstraint hc, Group *g) {
     int i;
     // Generate all the equations from constraints in this group
@@ -359,7 +913,118 @@ void System::WriteEquationsExceptFor(hConstraint hc, Group *g) {
     g->GenerateEquations(&eq);
 }
 
+//-----------------------------------------------------------------------------
+// The Jacobian doesn't have full rank, so there are combinations of its rows
+// that add up to zero. Removing a constraint fixes that if and only if every
+// one of those combinations uses its rows; that is, if the coefficients of
+// its rows in a basis for them have full rank. We get that basis from one
+// rank-revealing factorization, instead of writing and factoring the system
+// again without each constraint in turn.
+//-----------------------------------------------------------------------------
 void System::FindWhichToRemoveToFixJacobian(Group *g, List<hConstraint> *bad, bool forceDofCheck) {
+    int a, i, k;
+
+    // Write everything, and don't substitute, since that would take some
+    // of the constraints' equations out of the Jacobian. The substituted
+    // params haven't been written back yet, so they're stale until we do.
+    for(i = 0; i < param.n; i++) {
+        Param *p = &(param.elem[i]);
+        if(p->tag == VAR_SUBSTITUTED) p->val = param.FindById(p->substd)->val;
+    }
+    param.ClearTags();
+    eq.Clear();
+    WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+    eq.ClearTags();
+    WriteJacobian(0);
+    EvalJacobian();
+
+    double tol = RANK_MAG_TOLERANCE*RANK_MAG_TOLERANCE;
+    mat.factor.Analyze(mat.A);
+    int nullity = mat.m - mat.factor.FactorLdl(mat.A, tol, 0);
+    if(nullity == 0) {
+        // The rank test that got us here substituted, so rounding can make
+        // it come out differently; do it the slow way, like that did.
+        FindWhichToRemoveOneByOne(g, bad, forceDofCheck);
+        return;
+    }
+
+    // The basis, by rows of the Jacobian: the coefficient of each row in
+    // each combination, scaled so that the biggest in each is one.
+    std::vector<std::vector<std::pair<int, double>>> coeff(mat.m);
+    std::vector<std::pair<int, double>> dep;
+    int v = 0;
+    for(k = 0; k < mat.m; k++) {
+        if(!mat.factor.dropped[k]) continue;
+        mat.factor.FindDependency(k, &dep);
+        double biggest = 0;
+        for(auto &rc : dep) {
+            biggest = std::max(biggest, ffabs(rc.second));
+        }
+        for(auto &rc : dep) {
+            coeff[rc.first].push_back(std::make_pair(v, rc.second/biggest));
+        }
+        v++;
+    }
+
+    // Which rows come from which constraint
+    std::vector<std::pair<uint32_t, int>> rowOf;
+    for(i = 0; i < mat.m; i++) {
+        if(!mat.eq[i].isFromConstraint()) continue;
+        rowOf.push_back(std::make_pair(mat.eq[i].constraint().v, i));
+    }
+    std::sort(rowOf.begin(), rowOf.end());
+
+    for(a = 0; a < 2; a++) {
+        for(i = 0; i < SK.constraint.n; i++) {
+            ConstraintBase *c = &(SK.constraint.elem[i]);
+            if(c->group.v != g->h.v) continue;
+            if((c->type == Constraint::Type::POINTS_COINCIDENT && a == 0) ||
+               (c->type != Constraint::Type::POINTS_COINCIDENT && a == 1))
+            {
+                // Do the constraints in two passes: first everything but
+                // the point-coincident constraints, then only those
+                // constraints (so they appear last in the list).
+                continue;
+            }
+
+            auto first = std::lower_bound(rowOf.begin(), rowOf.end(),
+                                          std::make_pair(c->h.v, 0));
+            auto last = first;
+            while(last != rowOf.end() && last->first == c->h.v) last++;
+            int rows = (int)(last - first);
+            // Each row can break at most one combination.
+            if(rows < nullity) continue;
+
+            // The coefficients of its rows, a column for each combination;
+            // Gram-Schmidt on those tells us if they're independent.
+            std::vector<std::vector<double>> col(nullity, std::vector<double>(rows, 0.0));
+            for(auto it = first; it != last; it++) {
+                for(auto &vc : coeff[it->second]) {
+                    col[vc.first][it - first] = vc.second;
+                }
+            }
+            bool fixes = true;
+            for(v = 0; v < nullity && fixes; v++) {
+                for(int u = 0; u < v; u++) {
+                    double dot = 0;
+                    for(k = 0; k < rows; k++) dot += col[u][k]*col[v][k];
+                    for(k = 0; k < rows; k++) col[v][k] -= dot*col[u][k];
+                }
+                double mag = 0;
+                for(k = 0; k < rows; k++) mag += col[v][k]*col[v][k];
+                if(mag <= tol) {
+                    fixes = false;
+                } else {
+                    for(k = 0; k < rows; k++) col[v][k] /= sqrt(mag);
+                }
+            }
+            if(fixes) bad->Add(&(c->h));
+        }
+    }
+}
+
+// Try removing each constraint in turn, and see whether that fixes the rank.
+void System::FindWhichToRemoveOneByOne(Group *g, List<hConstraint> *bad, bool forceDofCheck) {
     int a, i;
 
     for(a = 0; a < 2; a++) {
@@ -398,13 +1063,147 @@ void System::FindWhichToRemoveToFixJacobian(Group *g, List<hConstraint> *bad, bo
     }
 }
 
-SolveResult System::Solve(Group *g, int *dof, List<hConstraint> *bad,
-                          bool andFindBad, bool andFindFree, bool forceDofCheck)
+// Add the constraints whose equations we didn't manage to satisfy to the
+// list of bad ones, just once each; the caller clears the constraint tags.
+static void AddUnsatisfied(const std::vector<hEquation> &eqs,
+                           const std::vector<double> &residual,
+                           List<hConstraint> *bad)
 {
-    WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
+    for(size_t i = 0; i < eqs.size(); i++) {
+        if(ffabs(residual[i]) > System::CONVERGE_TOLERANCE || isnan(residual[i])) {
+            // This constraint is unsatisfied.
+            if(!eqs[i].isFromConstraint()) continue;
 
-    int i;
-    bool rankOk;
+            hConstraint hc = eqs[i].constraint();
+            ConstraintBase *c = SK.constraint.FindByIdNoOops(hc);
+            if(!c) continue;
+            // Don't double-show constraints that generated multiple
+            // unsatisfied equations
+            if(!c->tag) {
+                bad->Add(&(c->h));
+                c->tag = 1;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Find the equations that are soluble alone, since they refer to just one
+// unknown that no other such equation refers to, and compile them. This can
+// be a huge speedup. We don't know whether the system is consistent yet, but
+// if it isn't then we'll catch that later.
+//-----------------------------------------------------------------------------
+void System::WriteAlone() {
+    alone.eq.clear();
+    alone.param.clear();
+    alone.wrt.clear();
+    alone.tape.Clear();
+
+    for(int i = 0; i < eq.n; i++) {
+        Equation *e = &(eq.elem[i]);
+        if(e->tag != 0) continue;
+
+        hParam hp = e->e->ReferencedParams(&param);
+        if(hp.v == Expr::NO_PARAMS.v) continue;
+        if(hp.v == Expr::MULTIPLE_PARAMS.v) continue;
+
+        Param *p = param.FindById(hp);
+        if(p->tag != 0) continue; // let rank test catch inconsistency
+
+        e->tag = EQ_SOLVED_ALONE;
+        p->tag = VAR_SOLVED_ALONE;
+
+        Expr *f = e->e->DeepCopyWithParamsAsPointers(&param, &(SK.param));
+        f = f->FoldConstants();
+        int r = alone.tape.Add(f);
+
+        int wrt = -1;
+        for(int k = alone.tape.usedStart[r]; k < alone.tape.usedStart[r + 1]; k++) {
+            int reg = alone.tape.used[k];
+            if(alone.tape.slotParam[alone.tape.code[reg].a] == p) wrt = reg;
+        }
+        alone.eq.push_back(e->h);
+        alone.param.push_back(p);
+        alone.wrt.push_back(wrt);
+    }
+    alone.f.assign(alone.eq.size(), 0.0);
+}
+
+//-----------------------------------------------------------------------------
+// Solve the equations from WriteAlone(). Each is one equation in one unknown,
+// so the least squares step is just f/f' (with the same scaling for dragged
+// params that SolveLeastSquares() would apply), and we can take it for all
+// of them at once, evaluating them from the same tape. Returns false if any
+// of them didn't converge.
+//-----------------------------------------------------------------------------
+bool System::SolveAlone() {
+    int n = (int)alone.eq.size();
+    if(n == 0) return true;
+
+    std::vector<bool> converged(n, false);
+    int left = n, iter = 0, i;
+
+    alone.tape.Eval(alone.f.data());
+    do {
+        stats.iterations++;
+
+        for(i = 0; i < n; i++) {
+            if(converged[i]) continue;
+
+            double df = 0;
+            if(alone.wrt[i] >= 0) alone.tape.Partials(i, &(alone.wrt[i]), 1, &df);
+
+            Param *p = alone.param[i];
+            double s = IsDragged(p->h) ? 1/20.0 : 1;
+            // The LDL' of the 1x1 A*A' drops the pivot if it's too small.
+            double as = df*s, d = as*as;
+            if(d > 1e-20) p->val -= as*(alone.f[i]/d)*s;
+            if(isnan(p->val)) return false;
+        }
+
+        alone.tape.Eval(alone.f.data());
+        for(i = 0; i < n; i++) {
+            if(converged[i]) continue;
+            if(isnan(alone.f[i])) return false;
+            if(ffabs(alone.f[i]) <= CONVERGE_TOLERANCE) {
+                converged[i] = true;
+                left--;
+            }
+        }
+    } while(iter++ < 50 && left > 0);
+
+    return left == 0;
+}
+
+// Solve one of the parts from SplitInToParts(), just like we would the
+// leftovers of the whole system; its Jacobian is already written.
+SolveResult System::SolvePart(bool andFindFree) {
+    stats.iterations = 0;
+    stats.evalTime = stats.solveTime = stats.rankTime = 0;
+
+    StartFromGuess();
+    bool rankOk = TestRank();
+    if(!NewtonSolve(0)) {
+        return rankOk ? SolveResult::DIDNT_CONVERGE :
+                        SolveResult::REDUNDANT_DIDNT_CONVERGE;
+    }
+
+    rankOk = TestRank();
+    if(rankOk) MarkParamsFree(andFindFree);
+    return rankOk ? SolveResult::OKAY : SolveResult::REDUNDANT_OKAY;
+}
+
+//-----------------------------------------------------------------------------
+// Write the equations, substitute, find the ones that are soluble alone, and
+// split what's left in to parts and write their Jacobians; everything that
+// depends on which equations we're solving, but not on the values of the
+// params. After this, SolvePrepared() does the rest, and can be called again
+// if only the values have changed.
+//-----------------------------------------------------------------------------
+void System::Prepare(Group *g, bool forceDofCheck) {
+    double startTime = GetSeconds();
+
+    WriteEquationsExceptFor(Constraint::NO_CONSTRAINT, g);
 
 /*
     dbp("%d equations", eq.n);
@@ -419,64 +1218,206 @@ SolveResult System::Solve(Group *g, int *dof, List<hConstraint> *bad,
     // All params and equations are assigned to group zero.
     param.ClearTags();
     eq.ClearTags();
+    stats.generateTime += GetSeconds() - startTime;
 
     if(!forceDofCheck) {
         SolveBySubstitution();
     }
 
     // Before solving the big system, see if we can find any equations that
-    // are soluble alone. This can be a huge speedup. We don't know whether
-    // the system is consistent yet, but if it isn't then we'll catch that
-    // later.
-    int alone = 1;
-    for(i = 0; i < eq.n; i++) {
-        Equation *e = &(eq.elem[i]);
-        if(e->tag != 0) continue;
-
-        hParam hp = e->e->ReferencedParams(&param);
-        if(hp.v == Expr::NO_PARAMS.v) continue;
-        if(hp.v == Expr::MULTIPLE_PARAMS.v) continue;
-
-        Param *p = param.FindById(hp);
-        if(p->tag != 0) continue; // let rank test catch inconsistency
-
-        e->tag = alone;
-        p->tag = alone;
-        WriteJacobian(alone);
-        if(!NewtonSolve(alone)) {
-            // We don't do the rank test, so let's arbitrarily return
-            // the DIDNT_CONVERGE result here.
-            rankOk = true;
-            // Failed to converge, bail out early
-            goto didnt_converge;
+    // are soluble alone.
+    WriteAlone();
+
+    // What's left often falls apart in to pieces that have no unknowns in
+    // common, like separate parts of the sketch. Those are cheaper to solve
+    // one by one than all together, and we can solve them in parallel.
+    unreferenced = SplitInToParts(&parts);
+    if(!parts.empty()) {
+        Sketch *sketch = &SK;
+        ParallelFor((int)parts.size(), [&](int k) {
+            // The worker has its own heap for the expressions it writes, and
+            // needs our sketch for the params that we don't have. Only the
+            // compiled tape is kept, so we can free those right away.
+            Sketch *oldSketch = ActiveSketch;
+            ActiveSketch = sketch;
+            TemporaryHeap heap = {};
+            TemporaryHeap *oldHeap = SetTemporaryHeap(&heap);
+
+            System *part = &(parts[k]);
+            part->stats = {};
+            part->WriteJacobian(0);
+            part->stats.unknowns  = part->mat.n;
+            part->stats.equations = part->mat.m;
+            part->stats.nonzeros  = (int)part->mat.A.col.size();
+
+            FreeAllTemporary();
+            SetTemporaryHeap(oldHeap);
+            ActiveSketch = oldSketch;
+        });
+        for(System &part : parts) {
+            stats.jacobianTime += part.stats.jacobianTime;
         }
-        alone++;
+    } else {
+        // Now write the Jacobian for what's left.
+        WriteJacobian(0);
     }
+    prepared = true;
+}
 
-    // Now write the Jacobian for what's left, and do a rank test; that
-    // tells us if the system is inconsistently constrained.
-    if(!WriteJacobian(0)) {
-        return SolveResult::TOO_MANY_UNKNOWNS;
+SolveResult System::SolvePrepared(Group *g, int *dof, List<hConstraint> *bad,
+                                  bool andFindBad, bool andFindFree, bool forceDofCheck)
+{
+    int i;
+    bool rankOk;
+
+    if(!SolveAlone()) {
+        // We don't do the rank test, so let's arbitrarily return
+        // the DIDNT_CONVERGE result here.
+        SK.constraint.ClearTags();
+        AddUnsatisfied(alone.eq, alone.f, bad);
+        return SolveResult::DIDNT_CONVERGE;
     }
 
-    rankOk = TestRank();
+    if(!parts.empty()) {
+        // The parts have copies of our params, so bring them up to date,
+        // knowns included, since some of those were just solved alone; and
+        // the same goes for how to solve, which may have changed since.
+        for(System &part : parts) {
+            part.backend      = backend;
+            part.method       = method;
+            part.parallelRows = parallelRows;
+            for(Param &pp : part.param) {
+                Param *p = param.FindById(pp.h);
+                pp.val   = p->val;
+                pp.guess = p->guess;
+            }
+        }
 
-    // And do the leftovers as one big system
-    if(!NewtonSolve(0)) {
-        goto didnt_converge;
-    }
+        std::vector<SolveResult> results(parts.size());
+        std::vector<int> order(parts.size());
+        for(i = 0; i < (int)parts.size(); i++) {
+            order[i] = i;
+        }
+        // Biggest first, so that nobody's left with a big one at the end.
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return parts[a].eq.n > parts[b].eq.n;
+        });
+
+        Sketch *sketch = &SK;
+        ParallelFor((int)parts.size(), [&](int k) {
+            Sketch *oldSketch = ActiveSketch;
+            ActiveSketch = sketch;
+            TemporaryHeap heap = {};
+            TemporaryHeap *oldHeap = SetTemporaryHeap(&heap);
+
+            results[order[k]] = parts[order[k]].SolvePart(andFindFree);
+
+            FreeAllTemporary();
+            SetTemporaryHeap(oldHeap);
+            ActiveSketch = oldSketch;
+        });
+
+        bool converged = true;
+        rankOk = true;
+        int partDof = unreferenced;
+        for(i = 0; i < (int)parts.size(); i++) {
+            System *part = &(parts[i]);
+            stats.unknowns     += part->stats.unknowns;
+            stats.equations    += part->stats.equations;
+            stats.nonzeros     += part->stats.nonzeros;
+            stats.iterations    = std::max(stats.iterations, part->stats.iterations);
+            stats.evalTime     += part->stats.evalTime;
+            stats.solveTime    += part->stats.solveTime;
+            stats.rankTime     += part->stats.rankTime;
+
+            switch(results[i]) {
+                case SolveResult::OKAY:                                 break;
+                case SolveResult::REDUNDANT_OKAY:       rankOk = false; break;
+                case SolveResult::DIDNT_CONVERGE:    converged = false; break;
+                case SolveResult::REDUNDANT_DIDNT_CONVERGE:
+                    rankOk = false;
+                    converged = false;
+                    break;
+                default: ssassert(false, "Unexpected result");
+            }
+            partDof += part->CalculateDof();
+        }
 
-    rankOk = TestRank();
-    if(!rankOk) {
-        if(!g->allowRedundant) {
-            if(andFindBad) FindWhichToRemoveToFixJacobian(g, bad, forceDofCheck);
+        if(!converged) {
+            SK.constraint.ClearTags();
+            for(i = 0; i < (int)parts.size(); i++) {
+                if(results[i] == SolveResult::DIDNT_CONVERGE ||
+                   results[i] == SolveResult::REDUNDANT_DIDNT_CONVERGE)
+                {
+                    AddUnsatisfied(parts[i].mat.eq, parts[i].mat.B.num, bad);
+                }
+            }
+            return rankOk ? SolveResult::DIDNT_CONVERGE :
+                            SolveResult::REDUNDANT_DIDNT_CONVERGE;
+        }
+
+        // Bring the solution back in to our own params. The unknowns that no
+        // equation refers to are free, if anyone wants to know.
+        for(i = 0; i < param.n; i++) {
+            Param *p = &(param.elem[i]);
+            p->free = (p->tag == 0) && andFindFree;
+        }
+        for(System &part : parts) {
+            for(Param &pp : part.param) {
+                if(pp.tag != 0) continue;
+                Param *p = param.FindById(pp.h);
+                p->val  = pp.val;
+                p->free = pp.free;
+            }
+        }
+        // And looking for the free ones rewrote the parts' Jacobians.
+        if(andFindFree) prepared = false;
+
+        if(!rankOk) {
+            if(!g->allowRedundant) {
+                if(andFindBad) {
+                    FindWhichToRemoveToFixJacobian(g, bad, forceDofCheck);
+                    prepared = false;
+                }
+            }
+        } else {
+            if(dof) *dof = partDof;
         }
     } else {
-        // This is not the full Jacobian, but any substitutions or single-eq
-        // solves removed one equation and one unknown, therefore no effect
-        // on the number of DOF.
-        if(dof) *dof = CalculateDof();
-        MarkParamsFree(andFindFree);
+        stats.unknowns  = mat.n;
+        stats.equations = mat.m;
+        stats.nonzeros  = (int)mat.A.col.size();
+
+        StartFromGuess();
+
+        // Do a rank test; that tells us if the system is inconsistently
+        // constrained.
+        rankOk = TestRank();
+
+        // And do the leftovers as one big system
+        if(!NewtonSolve(0)) {
+            SK.constraint.ClearTags();
+            AddUnsatisfied(mat.eq, mat.B.num, bad);
+            return rankOk ? SolveResult::DIDNT_CONVERGE :
+                            SolveResult::REDUNDANT_DIDNT_CONVERGE;
+        }
+
+        rankOk = TestRank();
+        if(!rankOk) {
+            if(!g->allowRedundant) {
+                if(andFindBad) {
+                    FindWhichToRemoveToFixJacobian(g, bad, forceDofCheck);
+                    prepared = false;
+                }
+            }
+        } else {
+            // This is not the full Jacobian, but any substitutions or single-eq
+            // solves removed one equation and one unknown, therefore no effect
+            // on the number of DOF.
+            if(dof) *dof = CalculateDof();
+            MarkParamsFree(andFindFree);
+            if(andFindFree) prepared = false;
+        }
     }
     // System solved correctly, so write the new values back in to the
     // main parameter table.
@@ -494,27 +1435,25 @@ SolveResult System::Solve(Group *g, int *dof, List<hConstraint> *bad,
         pp->free = p->free;
     }
     return rankOk ? SolveResult::OKAY : SolveResult::REDUNDANT_OKAY;
+}
 
-didnt_converge:
-    SK.constraint.ClearTags();
-    for(i = 0; i < eq.n; i++) {
-        if(ffabs(mat.B.num[i]) > CONVERGE_TOLERANCE || isnan(mat.B.num[i])) {
-            // This constraint is unsatisfied.
-            if(!mat.eq[i].isFromConstraint()) continue;
-
-            hConstraint hc = mat.eq[i].constraint();
-            ConstraintBase *c = SK.constraint.FindByIdNoOops(hc);
-            if(!c) continue;
-            // Don't double-show constraints that generated multiple
-            // unsatisfied equations
-            if(!c->tag) {
-                bad->Add(&(c->h));
-                c->tag = 1;
-            }
-        }
-    }
+SolveResult System::Solve(Group *g, int *dof, List<hConstraint> *bad,
+                          bool andFindBad, bool andFindFree, bool forceDofCheck)
+{
+    stats = {};
+    Prepare(g, forceDofCheck);
+    return SolvePrepared(g, dof, bad, andFindBad, andFindFree, forceDofCheck);
+}
 
-    return rankOk ? SolveResult::DIDNT_CONVERGE : SolveResult::REDUNDANT_DIDNT_CONVERGE;
+// Solve the same equations as last time, from the current values of the
+// params; this is what makes dragging cheap, since nothing but the values
+// has changed from one frame to the next.
+SolveResult System::SolveAgain(Group *g, int *dof, List<hConstraint> *bad,
+                               bool andFindBad, bool andFindFree, bool forceDofCheck)
+{
+    ssassert(prepared, "Nothing prepared to solve again");
+    stats = {};
+    return SolvePrepared(g, dof, bad, andFindBad, andFindFree, forceDofCheck);
 }
 
 SolveResult System::SolveRank(Group *g, int *dof, List<hConstraint> *bad,
@@ -532,9 +1471,7 @@ SolveResult System::SolveRank(Group *g, int *dof, List<hConstraint> *bad,
 
     // Now write the Jacobian, and do a rank test; that
     // tells us if the system is inconsistently constrained.
-    if(!WriteJacobian(0)) {
-        return SolveResult::TOO_MANY_UNKNOWNS;
-    }
+    WriteJacobian(0);
 
     bool rankOk = TestRank();
     if(!rankOk) {
@@ -556,6 +1493,11 @@ void System::Clear() {
     param.Clear();
     eq.Clear();
     dragged.Clear();
+    for(System &part : parts) {
+        part.Clear();
+    }
+    parts.clear();
+    prepared = false;
 }
 
 void System::MarkParamsFree(bool find) {
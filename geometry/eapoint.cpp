@@ -27,6 +27,12 @@ bool EaPoint::onDragWithConstraints(double x, double y)
     qDebug() << "EaPoint: onDragWithConstraints called for point" << m_id << "to position" << x << y;
     EaSession* session = EaSession::getInstance();
 
+    // 有求解线程时只提交拖拽目标，不等待求解：先按简单拖拽显示，
+    // 求解结果到达后会话再更新所有点
+    if (session->requestDragConstraint(m_id, x, y)) {
+        return onDrag(x, y);
+    }
+
     // 尝试使用约束求解
     bool success = session->solveDragConstraint(m_id, x, y);
     
@@ -1,10 +1,12 @@
 ﻿#include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <QThread>
 #include <QDebug>
 #include "main/eageosolver.h"
 #include "main/eadrawingarea.h"
 #include "main/easession.h"
+#include "main/easolverworker.h"
 
 int main(int argc, char *argv[])
 {
@@ -29,6 +31,13 @@ int main(int argc, char *argv[])
     // 设置GeometrySolver引用到EaSession
     session->setGeometrySolver(&solver);
     
+    // 拖拽求解放到单独的线程中，界面线程只提交拖拽目标
+    QThread solverThread;
+    EaSolverWorker solverWorker;
+    solverWorker.moveToThread(&solverThread);
+    solverThread.start();
+    session->setSolverWorker(&solverWorker);
+    
     // 将solver和session实例作为上下文属性暴露给QML
     engine.rootContext()->setContextProperty("globalSolver", &solver);
     engine.rootContext()->setContextProperty("globalSession", session);
@@ -45,5 +54,9 @@ int main(int argc, char *argv[])
         Qt::QueuedConnection);
     engine.load(url);
 
-    return app.exec();
+    int result = app.exec();
+    
+    solverThread.quit();
+    solverThread.wait();
+    return result;
 }
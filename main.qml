@@ -418,6 +418,17 @@ Window {
                                 wrapMode: Text.WordWrap
                                 Layout.fillWidth: true
                             }
+                            
+                            // 每次编辑后由结构分析更新，不需要等待求解
+                            Text {
+                                id: dofText
+                                text: globalSolver.overConstrained ? "过约束! 自由度: " + globalSolver.dof
+                                                                   : "自由度: " + globalSolver.dof
+                                color: globalSolver.overConstrained ? "red"
+                                                                    : (globalSolver.dof === 0 ? "green" : "black")
+                                font.pixelSize: 11
+                                Layout.fillWidth: true
+                            }
                         }
                     }
                     
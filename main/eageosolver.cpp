@@ -1,11 +1,25 @@
 ﻿#include "eageosolver.h"
 #include "easession.h"
 #include <QDebug>
+#include <algorithm>
 #include <set>
 
 GeometrySolver::GeometrySolver(QObject *parent)
     : QObject(parent)
+    , m_paramCapacity(0)
+    , m_entityCapacity(0)
+    , m_constraintCapacity(0)
+    , m_ctx(nullptr)
+    , m_group(0)
+    , m_nextParam(0)
+    , m_nextEntity(0)
+    , m_compileInput(nullptr)
+    , m_firstPointEntity(0)
+    , m_firstExtraParam(0)
+    , m_compiledRevision(-1)
     , m_dof(0)
+    , m_overConstrained(false)
+    , m_lastIterations(0)
     , m_solvedX1(0), m_solvedY1(0)
     , m_solvedX2(0), m_solvedY2(0)
 {
@@ -21,12 +35,15 @@ void GeometrySolver::initSystem()
 {
     memset(&m_sys, 0, sizeof(m_sys));
     
-    // 分配内存
-    m_sys.param = (Slvs_Param*)malloc(50 * sizeof(Slvs_Param));
-    m_sys.entity = (Slvs_Entity*)malloc(50 * sizeof(Slvs_Entity));
-    m_sys.constraint = (Slvs_Constraint*)malloc(50 * sizeof(Slvs_Constraint));
-    m_sys.failed = (Slvs_hConstraint*)malloc(50 * sizeof(Slvs_hConstraint));
-    m_sys.faileds = 50;
+    // 分配内存，之后每次建系统前按需要的数量扩大
+    reserveSystem(50, 50, 50);
+
+    // 创建求解上下文
+    m_ctx = Slvs_CreateContext();
+    // 拖拽幅度大时牛顿法容易发散，改用带阻尼的 Levenberg-Marquardt 迭代
+    Slvs_SetContextSolverMethod(m_ctx, SLVS_METHOD_LEVENBERG_MARQUARDT);
+    // 拖拽时根据前两帧的结果外推初值，减少每帧的迭代次数
+    Slvs_SetContextPredictor(m_ctx, 1);
 }
 
 void GeometrySolver::clearSystem()
@@ -37,13 +54,44 @@ void GeometrySolver::clearSystem()
     if (m_sys.failed) free(m_sys.failed);
     
     memset(&m_sys, 0, sizeof(m_sys));
+    m_paramCapacity = 0;
+    m_entityCapacity = 0;
+    m_constraintCapacity = 0;
+
+    // 释放求解上下文
+    Slvs_DestroyContext(m_ctx);
+    m_ctx = nullptr;
+}
+
+// 保证 m_sys 的数组至少能放下这么多参数、实体和约束。缓冲区在求解之间保留，
+// 不够时按两倍扩大，所以拖拽时系统大小不变就不会再分配内存
+void GeometrySolver::reserveSystem(int params, int entities, int constraints)
+{
+    if (params > m_paramCapacity) {
+        m_paramCapacity = std::max(params, 2 * m_paramCapacity);
+        m_sys.param = (Slvs_Param*)realloc(m_sys.param, m_paramCapacity * sizeof(Slvs_Param));
+    }
+    if (entities > m_entityCapacity) {
+        m_entityCapacity = std::max(entities, 2 * m_entityCapacity);
+        m_sys.entity = (Slvs_Entity*)realloc(m_sys.entity, m_entityCapacity * sizeof(Slvs_Entity));
+    }
+    if (constraints > m_constraintCapacity) {
+        m_constraintCapacity = std::max(constraints, 2 * m_constraintCapacity);
+        m_sys.constraint = (Slvs_Constraint*)realloc(m_sys.constraint, m_constraintCapacity * sizeof(Slvs_Constraint));
+        m_sys.failed = (Slvs_hConstraint*)realloc(m_sys.failed, m_constraintCapacity * sizeof(Slvs_hConstraint));
+    }
+    
+    // 求解后 faileds 是失败约束的个数，每次求解前都要重新设为数组容量
+    m_sys.faileds = m_constraintCapacity;
 }
 
 bool GeometrySolver::solveSimple2DDistance(double x1, double y1, 
                                             double x2, double y2, 
                                             double targetDistance)
 {
-    // 重置系统
+    // 重置系统，拖拽用的系统之后要重新编译
+    m_compiledRevision = -1;
+    reserveSystem(11, 5, 1);
     m_sys.params = 0;
     m_sys.entities = 0;
     m_sys.constraints = 0;
@@ -99,7 +147,7 @@ bool GeometrySolver::solveSimple2DDistance(double x1, double y1,
     m_sys.calculateFaileds = 1;
     
     // 求解
-    Slvs_Solve(&m_sys, g);
+    Slvs_SolveInContext(m_ctx, &m_sys, g);
     
     // 处理结果
     m_dof = m_sys.dof;
@@ -139,15 +187,135 @@ bool GeometrySolver::solveSimple2DDistance(double x1, double y1,
 }
 
 bool GeometrySolver::solveDragConstraint(int draggedPointId, double newX, double newY,
-                                        const std::map<std::string, std::map<std::string, std::any>>& pointPositions,
-                                        const std::vector<Constraint>& constraints,
-                                        const std::map<std::string, std::map<std::string, std::any>>& lineInfo)
+                                        const SolverInput& input,
+                                        const std::vector<Constraint>& constraints)
 {
     qDebug() << "GeometrySolver: solveDragConstraint called for point" << draggedPointId 
              << "to position" << newX << newY;
-    EaSession* session = EaSession::getInstance();
+    Slvs_hGroup g = buildSystem(draggedPointId, newX, newY, input, constraints);
+    
+    // 求解
+    Slvs_SolveInContext(m_ctx, &m_sys, g);
+    
+    Slvs_SolveStats stats;
+    Slvs_GetContextSolveStats(m_ctx, &stats);
+    m_lastIterations = stats.iterations;
+    qDebug() << "GeometrySolver: iterations:" << m_lastIterations;
+    
+    // 处理结果
+    m_dof = m_sys.dof;
+    m_overConstrained = (m_sys.result == SLVS_RESULT_INCONSISTENT);
+    emit dofChanged();
+    
+    if (m_sys.result == SLVS_RESULT_OKAY) {
+        // 保存求解后的坐标到成员变量（为了兼容现有接口）
+        // 按照点ID来分配坐标，而不是按照参数数组顺序
+        for (size_t i = 0; i < input.pointIds.size(); i++) {
+            const Slvs_Param* p = &m_sys.param[m_pointParam[i]];
+            if (input.pointIds[i] == 1) {
+                m_solvedX1 = p[0].val;
+                m_solvedY1 = p[1].val;
+            } else if (input.pointIds[i] == 2) {
+                m_solvedX2 = p[0].val;
+                m_solvedY2 = p[1].val;
+            }
+        }
+        
+        m_lastError = "拖拽约束求解成功";
+        qDebug() << "GeometrySolver: drag constraint solve successfully!";
+        qDebug() << "GeometrySolver: pt 1 after solve: (" << m_solvedX1 << ", " << m_solvedY1 << ")";
+        qDebug() << "GeometrySolver: pt 2 after solve: (" << m_solvedX2 << ", " << m_solvedY2 << ")";
+        qDebug() << "GeometrySolver: dof: " << m_dof;
+        
+        emit lastErrorChanged();
+        emit solvingFinished(true);
+        return true;
+    } else {
+        m_lastError = getResultMessage(m_sys.result);
+        
+        if (m_sys.faileds > 0) {
+            m_lastError += " - 问题约束: ";
+            for (int i = 0; i < m_sys.faileds; i++) {
+                m_lastError += QString::number(m_sys.failed[i]) + " ";
+            }
+        }
+        
+        qWarning() << "GeometrySolver: 拖拽约束求解失败:" << m_lastError;
+        emit lastErrorChanged();
+        emit solvingFinished(false);
+        return false;
+    }
+}
+
+// 根据点、线段和约束填写 m_sys，被拖拽的点使用新位置（draggedPointId 为 -1 时不替换任何点）。
+// 只有快照的版本变了（点、线段或约束有增删）才重新编译，拖拽时每帧只更新点的坐标。
+// 返回要求解的组
+Slvs_hGroup GeometrySolver::buildSystem(int draggedPointId, double newX, double newY,
+                                        const SolverInput& input,
+                                        const std::vector<Constraint>& constraints)
+{
+    if (m_compiledRevision != input.revision) {
+        compileSystem(input, constraints);
+        m_compiledRevision = input.revision;
+    } else if (m_sys.result != SLVS_RESULT_OKAY) {
+        // 上次没有解出来，约束额外建的参数（圆弧端点、半径）可能已经发散，恢复初值
+        for (size_t i = 0; i < m_extraSeeds.size(); i++) {
+            m_sys.param[m_firstExtraParam + i].val = m_extraSeeds[i];
+        }
+    }
+    
+    // 更新点的坐标，如果是被拖拽的点，使用新位置
+    for (size_t i = 0; i < input.pointIds.size(); i++) {
+        Slvs_Param* p = &m_sys.param[m_pointParam[i]];
+        if (input.pointIds[i] == draggedPointId) {
+            p[0].val = newX;
+            p[1].val = newY;
+        } else {
+            p[0].val = input.x[i];
+            p[1].val = input.y[i];
+        }
+    }
     
-    // 重置系统
+    // 不使用dragged数组，直接进行约束求解
+    for (int i = 0; i < 4; i++) {
+        m_sys.dragged[i] = 0;
+    }
+    
+    // 启用失败约束计算；求解后 faileds 是失败约束的个数，每次都要重新设为数组容量
+    m_sys.calculateFaileds = 1;
+    m_sys.faileds = m_constraintCapacity;
+    
+    return m_group;
+}
+
+// 每种约束的编译函数，下标是 ConstraintKind
+const GeometrySolver::CompileFunction GeometrySolver::s_compileTable[] = {
+    &GeometrySolver::compileDistance,        // ConstraintKind::Distance
+    &GeometrySolver::compileFixPoint,        // ConstraintKind::FixPoint
+    &GeometrySolver::compileDragPoint,       // ConstraintKind::DragPoint
+    &GeometrySolver::compileParallel,        // ConstraintKind::Parallel
+    &GeometrySolver::compilePerpendicular,   // ConstraintKind::Perpendicular
+    &GeometrySolver::compileHorizontal,      // ConstraintKind::Horizontal
+    &GeometrySolver::compileVertical,        // ConstraintKind::Vertical
+    &GeometrySolver::compileAngle,           // ConstraintKind::Angle
+    &GeometrySolver::compileArcLineTangent,  // ConstraintKind::ArcLineTangent
+    &GeometrySolver::compilePtOnLine,        // ConstraintKind::PtOnLine
+    &GeometrySolver::compilePtOnCircle,      // ConstraintKind::PtOnCircle
+    &GeometrySolver::compileSymmetricLine,   // ConstraintKind::SymmetricLine
+};
+
+// 把点、线段和约束翻译成 m_sys 中的参数、实体和约束
+void GeometrySolver::compileSystem(const SolverInput& input, const std::vector<Constraint>& constraints)
+{
+    static_assert(sizeof(s_compileTable) / sizeof(s_compileTable[0]) == (size_t)ConstraintKind::Count,
+                  "每种约束都要有编译函数");
+    
+    // 重置系统。工作平面有7个参数、3个实体，每个点有2个参数；
+    // 一个约束最多另外建4个参数（圆弧的起点和终点）、3个实体，再加一个直径约束
+    int nconstraints = (int)constraints.size();
+    reserveSystem(7 + 2 * (int)input.pointIds.size() + 4 * nconstraints,
+                  3 + (int)input.pointIds.size() + (int)input.lineIds.size() + 3 * nconstraints,
+                  2 * nconstraints);
     m_sys.params = 0;
     m_sys.entities = 0;
     m_sys.constraints = 0;
@@ -172,599 +340,337 @@ bool GeometrySolver::solveDragConstraint(int draggedPointId, double newX, double
     m_sys.entity[m_sys.entities++] = Slvs_MakeWorkplane(200, g, 101, 102);
     
     // 创建第二个组进行求解
-    g = 2;
+    m_group = 2;
     
-    // 创建所有点，并记录参数索引
-    std::map<int, int> pointToEntity; // 点ID到实体ID的映射
-    std::map<int, int> lineToEntity;  // 线段ID到实体ID的映射
-    std::map<int, int> centerToCircleEntity; // 圆心点ID到圆实体ID的映射
     // 清空之前的映射
-    m_pointToParamX.clear();
-    m_pointToParamY.clear();
-    
-    int paramIndex = 10;  // 从10开始，避免与工作平面参数ID冲突
-    int entityIndex = 300;
-    
-    // 创建所有点
-    for (const auto& it : pointPositions) {
-        int pointId = std::stoi(it.first);
-        const auto& pos = it.second;
-        double x = std::any_cast<double>(pos.at("x"));
-        double y = std::any_cast<double>(pos.at("y"));
-        
-        // 如果是被拖拽的点，使用新位置
-        if (pointId == draggedPointId) {
-            x = newX;
-            y = newY;
-            qDebug() << "GeometrySolver: Using new position for dragged point" << pointId << ":" << x << y;
-        }
-        
-        // 创建参数并记录索引
-        int paramXIndex = paramIndex++;
-        m_sys.param[m_sys.params++] = Slvs_MakeParam(paramXIndex, g, x);
-        int paramYIndex = paramIndex++;
-        m_sys.param[m_sys.params++] = Slvs_MakeParam(paramYIndex, g, y);
-        
-        // 记录参数索引到成员变量
-        m_pointToParamX[pointId] = paramXIndex;
-        m_pointToParamY[pointId] = paramYIndex;
-        
+    m_pointToEntity.clear();
+    m_lineToEntity.clear();
+    m_centerToCircleEntity.clear();
+    m_pointParam.resize(input.pointIds.size());
+    
+    m_nextParam = 10;  // 从10开始，避免与工作平面参数ID冲突
+    m_nextEntity = 300;
+    // 点实体按点在快照中的顺序连续编号，线段直接用端点下标找到点实体
+    const int firstPointEntity = m_nextEntity;
+    m_compileInput = &input;
+    m_firstPointEntity = firstPointEntity;
+    
+    // 创建所有点，坐标在 buildSystem 中每帧填写
+    for (size_t i = 0; i < input.pointIds.size(); i++) {
+        int pointId = input.pointIds[i];
+    
+        // 创建参数并记录X参数在数组中的下标
+        int paramXIndex = m_nextParam++;
+        int paramYIndex = m_nextParam++;
+        m_pointParam[i] = m_sys.params;
+        m_sys.param[m_sys.params++] = Slvs_MakeParam(paramXIndex, m_group, input.x[i]);
+        m_sys.param[m_sys.params++] = Slvs_MakeParam(paramYIndex, m_group, input.y[i]);
+    
         // 创建点实体
-        m_sys.entity[m_sys.entities++] = Slvs_MakePoint2d(entityIndex, g, 200, paramXIndex, paramYIndex);
-        pointToEntity[pointId] = entityIndex++;
-        
-        qDebug() << "GeometrySolver: Created point" << pointId << "at" << x << y 
-                 << "with params" << paramXIndex << paramYIndex << "in group" << g;
+        m_sys.entity[m_sys.entities++] = Slvs_MakePoint2d(m_nextEntity, m_group, 200, paramXIndex, paramYIndex);
+        m_pointToEntity[pointId] = m_nextEntity++;
     }
     
     // 创建线段实体
-    for (const auto& it : lineInfo) {
-        int lineId = std::stoi(it.first);
-        const auto& lineData = it.second;
-        int startPointId = std::any_cast<int>(lineData.at("startPoint"));
-        int endPointId = std::any_cast<int>(lineData.at("endPoint"));
-        
-        if (pointToEntity.find(startPointId) != pointToEntity.end() && 
-            pointToEntity.find(endPointId) != pointToEntity.end()) {
-            
-            // 创建线段实体
-            m_sys.entity[m_sys.entities++] = Slvs_MakeLineSegment(entityIndex, g, 200, 
-                                                                  pointToEntity[startPointId], 
-                                                                  pointToEntity[endPointId]);
-            lineToEntity[lineId] = entityIndex++;
-            
-            qDebug() << "GeometrySolver: Created line" << lineId << "from point" << startPointId 
-                     << "to point" << endPointId << "with entity" << lineToEntity[lineId];
+    for (size_t i = 0; i < input.lineIds.size(); i++) {
+        int lineId = input.lineIds[i];
+        int start = input.lineStart[i];
+        int end = input.lineEnd[i];
+    
+        if (start >= 0 && end >= 0) {
+            m_sys.entity[m_sys.entities++] = Slvs_MakeLineSegment(m_nextEntity, m_group, 200,
+                                                                  firstPointEntity + start,
+                                                                  firstPointEntity + end);
+            m_lineToEntity[lineId] = m_nextEntity++;
         } else {
-            qWarning() << "GeometrySolver: Cannot create line" << lineId << "- missing points" << startPointId << endPointId;
+            qWarning() << "GeometrySolver: Cannot create line" << lineId << "- missing points";
         }
     }
     
-    // 添加约束（包括创建圆实体）
-    qDebug() << "GeometrySolver: Adding constraints, total constraints to add:" << constraints.size();
+    // 添加约束（包括创建圆实体），按约束类型查表编译
+    m_firstExtraParam = m_sys.params;
     for (const Constraint& constraint : constraints) {
-        std::string type = constraint.type;
-        
-        qDebug() << "GeometrySolver: Processing constraint type:" << type.c_str() << "constraint id:" << constraint.id;
-        
-        if (type == "distance") {
-            int point1Id = std::any_cast<int>(constraint.data.at("point1"));
-            int point2Id = std::any_cast<int>(constraint.data.at("point2"));
-            double distance = std::any_cast<double>(constraint.data.at("distance"));
-            
-            qDebug() << "GeometrySolver: Distance constraint - point1Id:" << point1Id 
-                     << "point2Id:" << point2Id << "distance:" << distance;
-            qDebug() << "GeometrySolver: pointToEntity contains point1Id:" << (pointToEntity.find(point1Id) != pointToEntity.end())
-                     << "point2Id:" << (pointToEntity.find(point2Id) != pointToEntity.end());
-            
-            if (pointToEntity.find(point1Id) != pointToEntity.end() && pointToEntity.find(point2Id) != pointToEntity.end()) {
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_PT_PT_DISTANCE,
-                    200,
-                    distance,
-                    pointToEntity[point1Id], pointToEntity[point2Id], 0, 0);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added distance constraint" << constraintId 
-                         << "between points" << point1Id << "and" << point2Id 
-                         << "distance:" << distance << "entities:" << pointToEntity[point1Id] 
-                         << pointToEntity[point2Id];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add distance constraint - missing entities";
-            }
-        }
-        else if (type == "fix_point") {
-            int pointId = std::any_cast<int>(constraint.data.at("point"));
-            
-            if (pointToEntity.find(pointId) != pointToEntity.end()) {
-                // 添加固定点约束 - 使用WHERE_DRAGGED约束来固定点
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_WHERE_DRAGGED,
-                    200,
-                    0.0,
-                    pointToEntity[pointId], 0, 0, 0);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added fix point constraint" << constraintId
-                         << "for point" << pointId << "entity" << pointToEntity[pointId];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add fix point constraint - point" << pointId << "not found";
-            }
-        }
-        else if (type == "drag_point") {
-            // 拖拽约束现在通过dragged数组处理，不需要添加SLVS_C_WHERE_DRAGGED约束
-            qDebug() << "GeometrySolver: Skipping drag_point constraint - handled by dragged array";
-        }
-        else if (type == "parallel") {
-            int line1Id = std::any_cast<int>(constraint.data.at("line1"));
-            int line2Id = std::any_cast<int>(constraint.data.at("line2"));
-            
-            if (lineToEntity.find(line1Id) != lineToEntity.end() && 
-                lineToEntity.find(line2Id) != lineToEntity.end()) {
-                
-                // 添加平行约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_PARALLEL,
-                    200,
-                    0.0,
-                    0, 0,
-                    lineToEntity[line1Id], lineToEntity[line2Id]);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added parallel constraint" << constraintId
-                         << "between lines" << line1Id << "and" << line2Id 
-                         << "entities" << lineToEntity[line1Id] << lineToEntity[line2Id];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add parallel constraint - missing line entities" << line1Id << line2Id;
-            }
-        }
-        else if (type == "perpendicular") {
-            int line1Id = std::any_cast<int>(constraint.data.at("line1"));
-            int line2Id = std::any_cast<int>(constraint.data.at("line2"));
-            
-            if (lineToEntity.find(line1Id) != lineToEntity.end() && 
-                lineToEntity.find(line2Id) != lineToEntity.end()) {
-                
-                // 添加垂直约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_PERPENDICULAR,
-                    200,
-                    0.0,
-                    0, 0,
-                    lineToEntity[line1Id], lineToEntity[line2Id]);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added perpendicular constraint" << constraintId
-                         << "between lines" << line1Id << "and" << line2Id 
-                         << "entities" << lineToEntity[line1Id] << lineToEntity[line2Id];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add perpendicular constraint - missing line entities" << line1Id << line2Id;
-            }
-        }
-        else if (type == "horizontal") {
-            int lineId = std::any_cast<int>(constraint.data.at("line"));
-            
-            if (lineToEntity.find(lineId) != lineToEntity.end()) {
-                
-                // 添加水平约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_HORIZONTAL,
-                    200,
-                    0.0,
-                    0, 0, lineToEntity[lineId], 0);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added horizontal constraint" << constraintId
-                         << "for line" << lineId << "entity" << lineToEntity[lineId];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add horizontal constraint - missing line entity" << lineId;
-            }
-        }
-        else if (type == "vertical") {
-            int lineId = std::any_cast<int>(constraint.data.at("line"));
-
-            if (lineToEntity.find(lineId) != lineToEntity.end()) {
-
-                // 添加水平约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_VERTICAL,
-                    200,
-                    0.0,
-                    0, 0, lineToEntity[lineId], 0);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-
-                qDebug() << "GeometrySolver: Added vertical constraint" << constraintId
-                         << "for line" << lineId << "entity" << lineToEntity[lineId];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add vertical constraint - missing line entity" << lineId;
-            }
-        }
-        else if (type == "angle") {
-            int line1Id = std::any_cast<int>(constraint.data.at("line1"));
-            int line2Id = std::any_cast<int>(constraint.data.at("line2"));
-            double angle = std::any_cast<double>(constraint.data.at("angle"));
-            
-            if (lineToEntity.find(line1Id) != lineToEntity.end() && 
-                lineToEntity.find(line2Id) != lineToEntity.end()) {
-                
-                // 添加角度约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_ANGLE,
-                    200,
-                    angle,// * M_PI / 180.0,  // 角度转换为弧度
-                    0, 0,
-                    lineToEntity[line1Id], lineToEntity[line2Id]);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added angle constraint" << constraintId
-                         << "between lines" << line1Id << "and" << line2Id 
-                         << "entities" << lineToEntity[line1Id] << lineToEntity[line2Id]
-                         << "with angle" << angle << "degrees";
-            } else {
-                qWarning() << "GeometrySolver: Cannot add angle constraint - missing line entities" << line1Id << line2Id;
-            }
-        }
-        else if (type == "arc_line_tangent") {
-            int arcId = std::any_cast<int>(constraint.data.at("arc"));
-            int lineId = std::any_cast<int>(constraint.data.at("line"));
-            
-            // 查找圆弧和直线的实体ID
-            int arcEntityId = -1;
-            int lineEntityId = -1;
-            double arcRadius = 0.0;
-            int centerPointId = -1;
-            double startAngle = 0.0;
-            double endAngle = 0.0;
-            
-            // 查找圆弧信息（通过统一容器）
-            for (const auto& shape : session->getShapes()) {
-                if (auto arc = std::dynamic_pointer_cast<EaArc>(shape)) {
-                    if (arc->getId() == arcId) {
-                        EaPoint* centerPoint = arc->getCenter();
-                        if (centerPoint) {
-                            centerPointId = centerPoint->getId();
-                            arcRadius = arc->getRadius();
-                            startAngle = arc->getStartAngle();
-                            endAngle = arc->getEndAngle();
-                        }
-                        break;
-                    }
-                }
-            }
-            
-            // 查找直线实体ID
-            if (lineToEntity.find(lineId) != lineToEntity.end()) {
-                lineEntityId = lineToEntity[lineId];
-            }
-            
-            if (centerPointId != -1 && lineEntityId != -1 && 
-                pointToEntity.find(centerPointId) != pointToEntity.end()) {
-                
-                // 创建圆弧的起点和终点点实体
-                // 计算起点和终点的坐标
-                double centerX = 0.0, centerY = 0.0;
-                for (const auto& shape : session->getShapes()) {
-                    if (auto point = std::dynamic_pointer_cast<EaPoint>(shape)) {
-                        if (point->getId() == centerPointId) {
-                            centerX = point->pos().x();
-                            centerY = point->pos().y();
-                            break;
-                        }
-                    }
-                }
-                
-                // 计算起点坐标
-                double startX = centerX + arcRadius * cos(startAngle * M_PI / 180.0);
-                double startY = centerY + arcRadius * sin(startAngle * M_PI / 180.0);
-                
-                // 计算终点坐标
-                double endX = centerX + arcRadius * cos(endAngle * M_PI / 180.0);
-                double endY = centerY + arcRadius * sin(endAngle * M_PI / 180.0);
-                
-                qDebug() << "GeometrySolver: Arc calculation - center(" << centerX << "," << centerY 
-                         << ") radius" << arcRadius << "startAngle" << startAngle << "endAngle" << endAngle;
-                qDebug() << "GeometrySolver: Arc start point(" << startX << "," << startY 
-                         << ") end point(" << endX << "," << endY << ")";
-                
-                // 创建起点参数和实体
-                int startXParamIndex = paramIndex++;
-                m_sys.param[m_sys.params++] = Slvs_MakeParam(startXParamIndex, g, startX);
-                int startYParamIndex = paramIndex++;
-                m_sys.param[m_sys.params++] = Slvs_MakeParam(startYParamIndex, g, startY);
-                
-                int startPointEntityIndex = entityIndex++;
-                m_sys.entity[m_sys.entities++] = Slvs_MakePoint2d(startPointEntityIndex, g, 200, startXParamIndex, startYParamIndex);
-                
-                // 创建终点参数和实体
-                int endXParamIndex = paramIndex++;
-                m_sys.param[m_sys.params++] = Slvs_MakeParam(endXParamIndex, g, endX);
-                int endYParamIndex = paramIndex++;
-                m_sys.param[m_sys.params++] = Slvs_MakeParam(endYParamIndex, g, endY);
-                
-                int endPointEntityIndex = entityIndex++;
-                m_sys.entity[m_sys.entities++] = Slvs_MakePoint2d(endPointEntityIndex, g, 200, endXParamIndex, endYParamIndex);
-                
-                // 创建圆弧实体
-                arcEntityId = entityIndex++;
-                m_sys.entity[m_sys.entities++] = Slvs_MakeArcOfCircle(arcEntityId, g, 200, 102,
-                                                                      pointToEntity[centerPointId], 
-                                                                      startPointEntityIndex, 
-                                                                      endPointEntityIndex);
-                
-                // 首先添加直径约束来固定圆弧的半径
-                int diameterConstraintId = m_sys.constraints + 1;
-                Slvs_Constraint diameterConstraint = Slvs_MakeConstraint(
-                    diameterConstraintId, g,
-                    SLVS_C_DIAMETER,
-                    200,
-                    arcRadius * 2.0,  // 直径 = 半径 * 2
-                    0, 0, arcEntityId, 0);
-                diameterConstraint.entityC = 0;
-                diameterConstraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = diameterConstraint;
-                
-                // 然后添加圆弧与直线相切约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_ARC_LINE_TANGENT,
-                    200,
-                    0.0,
-                    0, 0, arcEntityId, lineEntityId);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Created arc entity" << arcEntityId 
-                         << "with center" << centerPointId << "start" << startPointEntityIndex << "end" << endPointEntityIndex;
-                qDebug() << "GeometrySolver: Added diameter constraint" << diameterConstraintId
-                         << "for arc" << arcId << "with radius" << arcRadius;
-                qDebug() << "GeometrySolver: Added arc-line tangent constraint" << constraintId
-                         << "between arc" << arcId << "and line" << lineId 
-                         << "entities" << arcEntityId << lineEntityId;
-            } else {
-                qWarning() << "GeometrySolver: Cannot add arc-line tangent constraint - missing entities" 
-                           << "arc" << arcId << "line" << lineId << "centerPoint" << centerPointId << "lineEntity" << lineEntityId;
-            }
-        }
-        else if (type == "pt_on_line") {
-            int pointId = std::any_cast<int>(constraint.data.at("point"));
-            int lineId = std::any_cast<int>(constraint.data.at("line"));
-            
-            if (pointToEntity.find(pointId) != pointToEntity.end() && 
-                lineToEntity.find(lineId) != lineToEntity.end()) {
-                
-                // 添加点在线上约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_PT_ON_LINE,
-                    200,
-                    0.0,
-                    pointToEntity[pointId], 0, lineToEntity[lineId], 0);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added point on line constraint" << constraintId
-                         << "for point" << pointId << "on line" << lineId 
-                         << "entities" << pointToEntity[pointId] << lineToEntity[lineId];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add point on line constraint - missing point or line entities" << pointId << lineId;
-            }
-        }
-        else if (type == "pt_on_circle") {
-            int pointId = std::any_cast<int>(constraint.data.at("point"));
-            int centerPointId = std::any_cast<int>(constraint.data.at("center"));
-            double radius = std::any_cast<double>(constraint.data.at("radius"));
-            
-            // 首先检查是否需要创建圆实体
-            if (centerToCircleEntity.find(centerPointId) == centerToCircleEntity.end() &&
-                pointToEntity.find(centerPointId) != pointToEntity.end()) {
-                
-                // 创建半径距离实体
-                int radiusParamIndex = paramIndex++;
-                m_sys.param[m_sys.params++] = Slvs_MakeParam(radiusParamIndex, g, radius);
-                
-                int radiusEntityIndex = entityIndex++;
-                m_sys.entity[m_sys.entities++] = Slvs_MakeDistance(radiusEntityIndex, g, 200, radiusParamIndex);
-                
-                // 创建圆实体
-                int circleEntityIndex = entityIndex++;
-                m_sys.entity[m_sys.entities++] = Slvs_MakeCircle(circleEntityIndex, g, 200,
-                                                                 pointToEntity[centerPointId], 102, radiusEntityIndex);
-                
-                // 使用圆心点ID作为键
-                centerToCircleEntity[centerPointId] = circleEntityIndex;
-                
-                // 添加直径约束来固定圆的半径
-                int diameterConstraintId = m_sys.constraints + 1;
-                Slvs_Constraint diameterConstraint = Slvs_MakeConstraint(
-                    diameterConstraintId, g,
-                    SLVS_C_DIAMETER,
-                    200,
-                    radius * 2.0,  // 直径 = 半径 * 2
-                    0, 0, circleEntityIndex, 0);
-                diameterConstraint.entityC = 0;
-                diameterConstraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = diameterConstraint;
-                
-                qDebug() << "GeometrySolver: Created circle with center point" << centerPointId 
-                         << "radius" << radius << "entity" << circleEntityIndex;
-                qDebug() << "GeometrySolver: Added diameter constraint" << diameterConstraintId 
-                         << "for circle" << circleEntityIndex << "diameter" << (radius * 2.0);
-            } else if (centerToCircleEntity.find(centerPointId) != centerToCircleEntity.end()) {
-                qDebug() << "GeometrySolver: Circle already exists for center point" << centerPointId;
-            } else {
-                qWarning() << "GeometrySolver: Cannot create circle - missing center point" << centerPointId;
-            }
-            
-            // 然后添加点在圆上约束
-            if (pointToEntity.find(pointId) != pointToEntity.end() && 
-                centerToCircleEntity.find(centerPointId) != centerToCircleEntity.end()) {
-                
-                // 添加点在圆上约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_PT_ON_CIRCLE,
-                    200,
-                    0.0,
-                    pointToEntity[pointId], 0, centerToCircleEntity[centerPointId], 0);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added point on circle constraint" << constraintId
-                         << "for point" << pointId << "on circle with center" << centerPointId 
-                         << "entities" << pointToEntity[pointId] << centerToCircleEntity[centerPointId];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add point on circle constraint - missing point or circle entities" << pointId << centerPointId;
-            }
-        }
-        else if (type == "symmetric_line") {
-            int point1Id = std::any_cast<int>(constraint.data.at("point1"));
-            int point2Id = std::any_cast<int>(constraint.data.at("point2"));
-            int lineId = std::any_cast<int>(constraint.data.at("line"));
-            
-            if (pointToEntity.find(point1Id) != pointToEntity.end() && 
-                pointToEntity.find(point2Id) != pointToEntity.end() && 
-                lineToEntity.find(lineId) != lineToEntity.end()) {
-                
-                // 添加关于直线对称的约束
-                int constraintId = m_sys.constraints + 1;
-                Slvs_Constraint constraint = Slvs_MakeConstraint(
-                    constraintId, g,
-                    SLVS_C_SYMMETRIC_LINE,
-                    200,
-                    0.0,
-                    pointToEntity[point1Id], pointToEntity[point2Id], lineToEntity[lineId], 0);
-                constraint.entityC = 0;
-                constraint.entityD = 0;
-                m_sys.constraint[m_sys.constraints++] = constraint;
-                
-                qDebug() << "GeometrySolver: Added symmetric line constraint" << constraintId
-                         << "for points" << point1Id << "and" << point2Id << "about line" << lineId 
-                         << "entities" << pointToEntity[point1Id] << pointToEntity[point2Id] << lineToEntity[lineId];
-            } else {
-                qWarning() << "GeometrySolver: Cannot add symmetric line constraint - missing point or line entities" 
-                           << "point1" << point1Id << "point2" << point2Id << "line" << lineId;
-            }
+        if (constraint.kind == ConstraintKind::Count) {
+            qWarning() << "GeometrySolver: Unknown constraint type:" << constraint.type.c_str() << "constraint id:" << constraint.id;
+            continue;
         }
+        (this->*s_compileTable[(int)constraint.kind])(constraint);
     }
     
-    qDebug() << "GeometrySolver: Total constraints added:" << m_sys.constraints;
+    m_compileInput = nullptr;
     
-    // 不使用dragged数组，直接进行约束求解
-    // 清空dragged数组
-    for (int i = 0; i < 4; i++) {
-        m_sys.dragged[i] = 0;
+    // 记录约束额外建的参数的初值
+    m_extraSeeds.clear();
+    for (int i = m_firstExtraParam; i < m_sys.params; i++) {
+        m_extraSeeds.push_back(m_sys.param[i].val);
     }
     
-    qDebug() << "GeometrySolver: Not using dragged array - relying on constraints only";
+    qDebug() << "GeometrySolver: Compiled" << input.pointIds.size() << "points," << input.lineIds.size()
+             << "lines and" << m_sys.constraints << "constraints";
+}
+
+// 查找点、线段对应的实体，找不到时返回 0
+Slvs_hEntity GeometrySolver::pointEntity(int pointId) const
+{
+    auto it = m_pointToEntity.find(pointId);
+    return (it != m_pointToEntity.end()) ? it->second : 0;
+}
+
+Slvs_hEntity GeometrySolver::lineEntity(int lineId) const
+{
+    auto it = m_lineToEntity.find(lineId);
+    return (it != m_lineToEntity.end()) ? it->second : 0;
+}
+
+void GeometrySolver::addConstraint(int type, double valA, Slvs_hEntity ptA, Slvs_hEntity ptB,
+                                   Slvs_hEntity entityA, Slvs_hEntity entityB)
+{
+    int constraintId = m_sys.constraints + 1;
+    Slvs_Constraint constraint = Slvs_MakeConstraint(
+        constraintId, m_group,
+        type,
+        200,
+        valA,
+        ptA, ptB, entityA, entityB);
+    constraint.entityC = 0;
+    constraint.entityD = 0;
+    m_sys.constraint[m_sys.constraints++] = constraint;
+}
+
+// 两条线段之间的约束（平行、垂直、角度）
+void GeometrySolver::compileLinePair(const Constraint& constraint, int type, double valA)
+{
+    int line1Id = std::any_cast<int>(constraint.data.at("line1"));
+    int line2Id = std::any_cast<int>(constraint.data.at("line2"));
+    Slvs_hEntity line1 = lineEntity(line1Id);
+    Slvs_hEntity line2 = lineEntity(line2Id);
+    
+    if (line1 && line2) {
+        addConstraint(type, valA, 0, 0, line1, line2);
+    } else {
+        qWarning() << "GeometrySolver: Cannot add" << constraint.type.c_str() << "constraint - missing line entities" << line1Id << line2Id;
+    }
+}
+
+// 一条线段上的约束（水平、垂直）
+void GeometrySolver::compileLine(const Constraint& constraint, int type)
+{
+    int lineId = std::any_cast<int>(constraint.data.at("line"));
+    Slvs_hEntity line = lineEntity(lineId);
     
-    // 输出每个点的参数ID
-    for (auto it = m_pointToParamX.begin(); it != m_pointToParamX.end(); ++it) {
-        int pointId = it->first;
-        qDebug() << "GeometrySolver: Point" << pointId << "X param:" << it->second 
-                 << "Y param:" << m_pointToParamY[pointId];
+    if (line) {
+        addConstraint(type, 0.0, 0, 0, line, 0);
+    } else {
+        qWarning() << "GeometrySolver: Cannot add" << constraint.type.c_str() << "constraint - missing line entity" << lineId;
     }
+}
+
+void GeometrySolver::compileDistance(const Constraint& constraint)
+{
+    int point1Id = std::any_cast<int>(constraint.data.at("point1"));
+    int point2Id = std::any_cast<int>(constraint.data.at("point2"));
+    double distance = std::any_cast<double>(constraint.data.at("distance"));
+    Slvs_hEntity point1 = pointEntity(point1Id);
+    Slvs_hEntity point2 = pointEntity(point2Id);
+    
+    if (point1 && point2) {
+        addConstraint(SLVS_C_PT_PT_DISTANCE, distance, point1, point2, 0, 0);
+    } else {
+        qWarning() << "GeometrySolver: Cannot add distance constraint - missing entities" << point1Id << point2Id;
+    }
+}
+
+void GeometrySolver::compileFixPoint(const Constraint& constraint)
+{
+    int pointId = std::any_cast<int>(constraint.data.at("point"));
+    Slvs_hEntity point = pointEntity(pointId);
     
-    // 启用失败约束计算
-    m_sys.calculateFaileds = 1;
+    if (point) {
+        // 添加固定点约束 - 使用WHERE_DRAGGED约束来固定点
+        addConstraint(SLVS_C_WHERE_DRAGGED, 0.0, point, 0, 0, 0);
+    } else {
+        qWarning() << "GeometrySolver: Cannot add fix point constraint - point" << pointId << "not found";
+    }
+}
+
+void GeometrySolver::compileDragPoint(const Constraint&)
+{
+    // 拖拽约束现在通过dragged数组处理，不需要添加SLVS_C_WHERE_DRAGGED约束
+}
+
+void GeometrySolver::compileParallel(const Constraint& constraint)
+{
+    compileLinePair(constraint, SLVS_C_PARALLEL, 0.0);
+}
+
+void GeometrySolver::compilePerpendicular(const Constraint& constraint)
+{
+    compileLinePair(constraint, SLVS_C_PERPENDICULAR, 0.0);
+}
+
+void GeometrySolver::compileHorizontal(const Constraint& constraint)
+{
+    compileLine(constraint, SLVS_C_HORIZONTAL);
+}
+
+void GeometrySolver::compileVertical(const Constraint& constraint)
+{
+    compileLine(constraint, SLVS_C_VERTICAL);
+}
+
+void GeometrySolver::compileAngle(const Constraint& constraint)
+{
+    double angle = std::any_cast<double>(constraint.data.at("angle"));
+    compileLinePair(constraint, SLVS_C_ANGLE, angle);
+}
+
+void GeometrySolver::compileArcLineTangent(const Constraint& constraint)
+{
+    const SolverInput& input = *m_compileInput;
+    int arcId = std::any_cast<int>(constraint.data.at("arc"));
+    int lineId = std::any_cast<int>(constraint.data.at("line"));
+    
+    // 在快照中查找圆弧和它的圆心
+    auto it = std::find(input.arcIds.begin(), input.arcIds.end(), arcId);
+    int arcIndex = (it != input.arcIds.end()) ? (int)(it - input.arcIds.begin()) : -1;
+    int centerIndex = (arcIndex >= 0) ? input.arcCenter[arcIndex] : -1;
+    
+    Slvs_hEntity line = lineEntity(lineId);
+    if (centerIndex < 0 || !line) {
+        qWarning() << "GeometrySolver: Cannot add arc-line tangent constraint - missing entities"
+                   << "arc" << arcId << "line" << lineId;
+        return;
+    }
+    Slvs_hEntity center = m_firstPointEntity + centerIndex;
+    
+    // 计算起点和终点的坐标
+    double arcRadius = input.arcRadius[arcIndex];
+    double startAngle = input.arcStart[arcIndex];
+    double endAngle = input.arcEnd[arcIndex];
+    double centerX = input.x[centerIndex];
+    double centerY = input.y[centerIndex];
+    double startX = centerX + arcRadius * cos(startAngle * M_PI / 180.0);
+    double startY = centerY + arcRadius * sin(startAngle * M_PI / 180.0);
+    double endX = centerX + arcRadius * cos(endAngle * M_PI / 180.0);
+    double endY = centerY + arcRadius * sin(endAngle * M_PI / 180.0);
+    
+    // 创建起点参数和实体
+    int startXParamIndex = m_nextParam++;
+    m_sys.param[m_sys.params++] = Slvs_MakeParam(startXParamIndex, m_group, startX);
+    int startYParamIndex = m_nextParam++;
+    m_sys.param[m_sys.params++] = Slvs_MakeParam(startYParamIndex, m_group, startY);
+    int startPointEntityIndex = m_nextEntity++;
+    m_sys.entity[m_sys.entities++] = Slvs_MakePoint2d(startPointEntityIndex, m_group, 200, startXParamIndex, startYParamIndex);
+    
+    // 创建终点参数和实体
+    int endXParamIndex = m_nextParam++;
+    m_sys.param[m_sys.params++] = Slvs_MakeParam(endXParamIndex, m_group, endX);
+    int endYParamIndex = m_nextParam++;
+    m_sys.param[m_sys.params++] = Slvs_MakeParam(endYParamIndex, m_group, endY);
+    int endPointEntityIndex = m_nextEntity++;
+    m_sys.entity[m_sys.entities++] = Slvs_MakePoint2d(endPointEntityIndex, m_group, 200, endXParamIndex, endYParamIndex);
+    
+    // 创建圆弧实体
+    int arcEntityId = m_nextEntity++;
+    m_sys.entity[m_sys.entities++] = Slvs_MakeArcOfCircle(arcEntityId, m_group, 200, 102,
+                                                          center, startPointEntityIndex, endPointEntityIndex);
+    
+    // 首先添加直径约束来固定圆弧的半径，然后添加圆弧与直线相切约束
+    addConstraint(SLVS_C_DIAMETER, arcRadius * 2.0, 0, 0, arcEntityId, 0);
+    addConstraint(SLVS_C_ARC_LINE_TANGENT, 0.0, 0, 0, arcEntityId, line);
+}
+
+void GeometrySolver::compilePtOnLine(const Constraint& constraint)
+{
+    int pointId = std::any_cast<int>(constraint.data.at("point"));
+    int lineId = std::any_cast<int>(constraint.data.at("line"));
+    Slvs_hEntity point = pointEntity(pointId);
+    Slvs_hEntity line = lineEntity(lineId);
     
-    // 求解
-    Slvs_Solve(&m_sys, g);
+    if (point && line) {
+        addConstraint(SLVS_C_PT_ON_LINE, 0.0, point, 0, line, 0);
+    } else {
+        qWarning() << "GeometrySolver: Cannot add point on line constraint - missing point or line entities" << pointId << lineId;
+    }
+}
+
+void GeometrySolver::compilePtOnCircle(const Constraint& constraint)
+{
+    int pointId = std::any_cast<int>(constraint.data.at("point"));
+    int centerPointId = std::any_cast<int>(constraint.data.at("center"));
+    double radius = std::any_cast<double>(constraint.data.at("radius"));
+    
+    // 首先检查是否需要创建圆实体，同一个圆心的圆只建一次
+    auto circle = m_centerToCircleEntity.find(centerPointId);
+    if (circle == m_centerToCircleEntity.end()) {
+        Slvs_hEntity center = pointEntity(centerPointId);
+        if (!center) {
+            qWarning() << "GeometrySolver: Cannot create circle - missing center point" << centerPointId;
+            return;
+        }
     
-    // 处理结果
-    m_dof = m_sys.dof;
-    emit dofChanged();
+        // 创建半径距离实体
+        int radiusParamIndex = m_nextParam++;
+        m_sys.param[m_sys.params++] = Slvs_MakeParam(radiusParamIndex, m_group, radius);
+        int radiusEntityIndex = m_nextEntity++;
+        m_sys.entity[m_sys.entities++] = Slvs_MakeDistance(radiusEntityIndex, m_group, 200, radiusParamIndex);
+    
+        // 创建圆实体，并添加直径约束来固定圆的半径
+        int circleEntityIndex = m_nextEntity++;
+        m_sys.entity[m_sys.entities++] = Slvs_MakeCircle(circleEntityIndex, m_group, 200,
+                                                         center, 102, radiusEntityIndex);
+        addConstraint(SLVS_C_DIAMETER, radius * 2.0, 0, 0, circleEntityIndex, 0);
+        circle = m_centerToCircleEntity.insert({centerPointId, circleEntityIndex}).first;
+    }
     
-    if (m_sys.result == SLVS_RESULT_OKAY) {
-        // 保存求解后的坐标到成员变量（为了兼容现有接口）
-        // 按照点ID来分配坐标，而不是按照参数数组顺序
-        for (int i = 0; i < m_sys.params; i++) {
-            if (m_sys.param[i].group == g) {
-                // 查找这个参数对应的点ID
-                for (auto it = m_pointToParamX.begin(); it != m_pointToParamX.end(); ++it) {
-                    int pointId = it->first;
-                    if (it->second == m_sys.param[i].h) {
-                        // 这是点ID的X坐标
-                        if (pointId == 1) {
-                            m_solvedX1 = m_sys.param[i].val;
-                        } else if (pointId == 2) {
-                            m_solvedX2 = m_sys.param[i].val;
-                        }
-                        break;
-                    }
-                }
-                for (auto it = m_pointToParamY.begin(); it != m_pointToParamY.end(); ++it) {
-                    int pointId = it->first;
-                    if (it->second == m_sys.param[i].h) {
-                        // 这是点ID的Y坐标
-                        if (pointId == 1) {
-                            m_solvedY1 = m_sys.param[i].val;
-                        } else if (pointId == 2) {
-                            m_solvedY2 = m_sys.param[i].val;
-                        }
-                        break;
-                    }
-                }
-            }
-        }
-        
-        m_lastError = "拖拽约束求解成功";
-        qDebug() << "GeometrySolver: drag constraint solve successfully!";
-        qDebug() << "GeometrySolver: pt 1 after solve: (" << m_solvedX1 << ", " << m_solvedY1 << ")";
-        qDebug() << "GeometrySolver: pt 2 after solve: (" << m_solvedX2 << ", " << m_solvedY2 << ")";
-        qDebug() << "GeometrySolver: dof: " << m_dof;
-        
-        emit lastErrorChanged();
-        emit solvingFinished(true);
-        return true;
+    // 然后添加点在圆上约束
+    Slvs_hEntity point = pointEntity(pointId);
+    if (point) {
+        addConstraint(SLVS_C_PT_ON_CIRCLE, 0.0, point, 0, circle->second, 0);
     } else {
-        m_lastError = getResultMessage(m_sys.result);
-        
-        if (m_sys.faileds > 0) {
-            m_lastError += " - 问题约束: ";
-            for (int i = 0; i < m_sys.faileds; i++) {
-                m_lastError += QString::number(m_sys.failed[i]) + " ";
-            }
-        }
-        
-        qWarning() << "GeometrySolver: 拖拽约束求解失败:" << m_lastError;
-        emit lastErrorChanged();
-        emit solvingFinished(false);
-        return false;
+        qWarning() << "GeometrySolver: Cannot add point on circle constraint - missing point" << pointId;
+    }
+}
+
+void GeometrySolver::compileSymmetricLine(const Constraint& constraint)
+{
+    int point1Id = std::any_cast<int>(constraint.data.at("point1"));
+    int point2Id = std::any_cast<int>(constraint.data.at("point2"));
+    int lineId = std::any_cast<int>(constraint.data.at("line"));
+    Slvs_hEntity point1 = pointEntity(point1Id);
+    Slvs_hEntity point2 = pointEntity(point2Id);
+    Slvs_hEntity line = lineEntity(lineId);
+    
+    if (point1 && point2 && line) {
+        addConstraint(SLVS_C_SYMMETRIC_LINE, 0.0, point1, point2, line, 0);
+    } else {
+        qWarning() << "GeometrySolver: Cannot add symmetric line constraint - missing point or line entities"
+                   << "point1" << point1Id << "point2" << point2Id << "line" << lineId;
+    }
+}
+
+bool GeometrySolver::analyzeStructure(const SolverInput& input,
+                                      const std::vector<Constraint>& constraints)
+{
+    Slvs_hGroup g = buildSystem(-1, 0.0, 0.0, input, constraints);
+    
+    // 和拖拽求解用同一个上下文：之后求解同一个系统时不用再写一遍方程，
+    // 系统没变时再次分析也直接返回上次的结果
+    Slvs_Structure structure;
+    Slvs_AnalyzeStructureInContext(m_ctx, &m_sys, g, &structure);
+    
+    bool overConstrained = (m_sys.result == SLVS_RESULT_INCONSISTENT);
+    qDebug() << "GeometrySolver: structural dof:" << structure.dof
+             << "redundant:" << structure.redundant
+             << "over-constrained constraints:" << m_sys.faileds;
+    
+    // 只在变化时通知，状态栏不必每次编辑都刷新
+    if (m_dof != structure.dof || m_overConstrained != overConstrained) {
+        m_dof = structure.dof;
+        m_overConstrained = overConstrained;
+        emit dofChanged();
     }
+    return !overConstrained;
 }
 
 QVariantMap GeometrySolver::getSolvedPoints()
@@ -777,36 +683,44 @@ QVariantMap GeometrySolver::getSolvedPoints()
     return result;
 }
 
-QVariantMap GeometrySolver::getSolvedPoints(const std::map<std::string, std::map<std::string, std::any>>& pointPositions)
+QVariantMap GeometrySolver::getSolvedPoints(const SolverInput& input)
 {
     QVariantMap result;
     
-    // 使用保存的参数映射来获取所有点的求解结果
-    for (const auto& pointIt : pointPositions) {
-        std::string pointIdStr = pointIt.first;
-        int pointId = std::stoi(pointIdStr);
-        
-        // 查找该点的X和Y参数
-        if (m_pointToParamX.find(pointId) != m_pointToParamX.end() && 
-            m_pointToParamY.find(pointId) != m_pointToParamY.end()) {
-            
-            int paramXIndex = m_pointToParamX[pointId];
-            int paramYIndex = m_pointToParamY[pointId];
-            
-            // 从参数数组中获取求解后的坐标
-            for (int i = 0; i < m_sys.params; i++) {
-                if (m_sys.param[i].h == paramXIndex) {
-                    result[QString("x%1").arg(pointId)] = m_sys.param[i].val;
-                } else if (m_sys.param[i].h == paramYIndex) {
-                    result[QString("y%1").arg(pointId)] = m_sys.param[i].val;
-                }
-            }
-        }
+    // 使用保存的参数下标来获取所有点的求解结果
+    for (size_t i = 0; i < input.pointIds.size() && i < m_pointParam.size(); i++) {
+        int pointId = input.pointIds[i];
+        const Slvs_Param* p = &m_sys.param[m_pointParam[i]];
+        result[QString("x%1").arg(pointId)] = p[0].val;
+        result[QString("y%1").arg(pointId)] = p[1].val;
     }
     
     return result;
 }
 
+void GeometrySolver::writeSolvedPoints(const std::vector<std::shared_ptr<EaPoint>>& points) const
+{
+    if (points.size() != m_pointParam.size()) {
+        qWarning() << "GeometrySolver: Cannot write back" << points.size() << "points, solved" << m_pointParam.size();
+        return;
+    }
+    
+    // 按下标表直接复制，不用查找
+    for (size_t i = 0; i < points.size(); i++) {
+        const Slvs_Param* p = &m_sys.param[m_pointParam[i]];
+        points[i]->setPosition(p[0].val, p[1].val, 0.0);
+    }
+}
+
+void GeometrySolver::writeSolvedPoints(SolverInput& input) const
+{
+    for (size_t i = 0; i < input.pointIds.size() && i < m_pointParam.size(); i++) {
+        const Slvs_Param* p = &m_sys.param[m_pointParam[i]];
+        input.x[i] = p[0].val;
+        input.y[i] = p[1].val;
+    }
+}
+
 QString GeometrySolver::getResultMessage(int result)
 {
     switch (result) {
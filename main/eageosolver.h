@@ -7,10 +7,13 @@
 #include <string>
 #include <any>
 #include <vector>
+#include <memory>
 #include <slvs.h>
 
 // 前向声明
 struct Constraint;
+struct SolverInput;
+class EaPoint;
 
 /**
  * @brief GeometrySolver类 - SolveSpaceLib的Qt封装
@@ -21,6 +24,7 @@ class GeometrySolver : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(int dof READ dof NOTIFY dofChanged)
+    Q_PROPERTY(bool overConstrained READ overConstrained NOTIFY dofChanged)
     Q_PROPERTY(QString lastError READ lastError NOTIFY lastErrorChanged)
 
 public:
@@ -29,6 +33,10 @@ public:
 
     // 属性访问器
     int dof() const { return m_dof; }
+    // 是否有过约束（结构分析或求解发现有多余的约束）
+    bool overConstrained() const { return m_overConstrained; }
+    // 上一次求解的牛顿迭代次数，用于在录制的拖拽轨迹上衡量预测器的效果
+    int lastIterations() const { return m_lastIterations; }
     QString lastError() const { return m_lastError; }
 
     // 简单的2D两点距离约束示例
@@ -38,13 +46,21 @@ public:
 
     // 拖拽约束求解 - 拖拽一个点，其他点根据约束调整
     Q_INVOKABLE bool solveDragConstraint(int draggedPointId, double newX, double newY,
-                                        const std::map<std::string, std::map<std::string, std::any>>& pointPositions,
-                                        const std::vector<Constraint>& constraints,
-                                        const std::map<std::string, std::map<std::string, std::any>>& lineInfo = {});
+                                        const SolverInput& input,
+                                        const std::vector<Constraint>& constraints);
+
+    // 结构分析 - 只根据每个约束涉及哪些参数计算自由度和过约束的约束，
+    // 不做牛顿迭代，每次编辑后都可以调用；返回 false 表示有过约束
+    Q_INVOKABLE bool analyzeStructure(const SolverInput& input,
+                                      const std::vector<Constraint>& constraints);
 
     // 获取求解后的点坐标
     Q_INVOKABLE QVariantMap getSolvedPoints();
-    Q_INVOKABLE QVariantMap getSolvedPoints(const std::map<std::string, std::map<std::string, std::any>>& pointPositions);
+    Q_INVOKABLE QVariantMap getSolvedPoints(const SolverInput& input);
+    // 把求解后的坐标直接写回点，points 的顺序要和求解时快照中的点一致
+    void writeSolvedPoints(const std::vector<std::shared_ptr<EaPoint>>& points) const;
+    // 把求解后的坐标写回求解时用的快照
+    void writeSolvedPoints(SolverInput& input) const;
 
 signals:
     void dofChanged();
@@ -54,19 +70,71 @@ signals:
 private:
     void initSystem();
     void clearSystem();
+    void reserveSystem(int params, int entities, int constraints);
+    Slvs_hGroup buildSystem(int draggedPointId, double newX, double newY,
+                            const SolverInput& input,
+                            const std::vector<Constraint>& constraints);
+    void compileSystem(const SolverInput& input, const std::vector<Constraint>& constraints);
+    
+    // 约束编译：每种约束一个编译函数，按 ConstraintKind 在 s_compileTable 中查找，
+    // 把约束翻译成 m_sys 中的约束（有的还要建圆、圆弧的参数和实体）
+    typedef void (GeometrySolver::*CompileFunction)(const Constraint& constraint);
+    static const CompileFunction s_compileTable[];
+    void compileDistance(const Constraint& constraint);
+    void compileFixPoint(const Constraint& constraint);
+    void compileDragPoint(const Constraint& constraint);
+    void compileParallel(const Constraint& constraint);
+    void compilePerpendicular(const Constraint& constraint);
+    void compileHorizontal(const Constraint& constraint);
+    void compileVertical(const Constraint& constraint);
+    void compileAngle(const Constraint& constraint);
+    void compileArcLineTangent(const Constraint& constraint);
+    void compilePtOnLine(const Constraint& constraint);
+    void compilePtOnCircle(const Constraint& constraint);
+    void compileSymmetricLine(const Constraint& constraint);
+    void compileLinePair(const Constraint& constraint, int type, double valA);
+    void compileLine(const Constraint& constraint, int type);
+    void addConstraint(int type, double valA, Slvs_hEntity ptA, Slvs_hEntity ptB,
+                       Slvs_hEntity entityA, Slvs_hEntity entityB);
+    Slvs_hEntity pointEntity(int pointId) const;
+    Slvs_hEntity lineEntity(int lineId) const;
     QString getResultMessage(int result);
 
     Slvs_System m_sys;
+    // m_sys 中各个数组的容量，failed 数组和 constraint 数组一样大
+    int m_paramCapacity;
+    int m_entityCapacity;
+    int m_constraintCapacity;
+    // 求解上下文：拖拽时每帧的系统结构相同、只有点坐标变化，
+    // 上下文会复用上一帧建好的方程和雅可比矩阵，直接进行牛顿迭代
+    Slvs_Context *m_ctx;
+    // 编译好的系统：要求解的组、编译时的ID映射和下一个参数、实体的编号
+    Slvs_hGroup m_group;
+    std::map<int, int> m_pointToEntity;        // 点ID到实体ID的映射
+    std::map<int, int> m_lineToEntity;         // 线段ID到实体ID的映射
+    std::map<int, int> m_centerToCircleEntity; // 圆心点ID到圆实体ID的映射
+    int m_nextParam;
+    int m_nextEntity;
+    // 正在编译的快照和其中第一个点的实体，编译函数从快照取点和圆弧，
+    // 不访问会话，所以可以在求解线程中编译
+    const SolverInput* m_compileInput;
+    int m_firstPointEntity;
+    // 约束额外建的参数从这个下标开始，以及它们的初值
+    int m_firstExtraParam;
+    std::vector<double> m_extraSeeds;
+    // 编译时快照的版本，不同时要重新编译，-1 表示还没有编译
+    int m_compiledRevision;
     int m_dof;
+    bool m_overConstrained;
+    int m_lastIterations;
     QString m_lastError;
     
     // 用于存储求解后的结果
     double m_solvedX1, m_solvedY1;
     double m_solvedX2, m_solvedY2;
     
-    // 用于存储参数映射，支持动态数量的点
-    std::map<int, int> m_pointToParamX; // 点ID到X参数索引的映射
-    std::map<int, int> m_pointToParamY; // 点ID到Y参数索引的映射
+    // 快照中每个点的X参数在 m_sys.param 中的下标，Y参数紧跟在后面
+    std::vector<int> m_pointParam;
 };
 
 #endif // EAGEOSOLVER_H
@@ -1,12 +1,39 @@
 ﻿#include "easession.h"
 #include "eageosolver.h"
+#include "easolverworker.h"
 #include <QDebug>
 #include <QVariantMap>
 #include <algorithm>
 
 EaSession *EaSession::instance = nullptr;
 
-EaSession::EaSession() : QObject(), m_geometrySolver(nullptr)
+ConstraintKind constraintKindFromType(const std::string& type)
+{
+    static const std::map<std::string, ConstraintKind> kinds = {
+        {"distance",         ConstraintKind::Distance},
+        {"fix_point",        ConstraintKind::FixPoint},
+        {"drag_point",       ConstraintKind::DragPoint},
+        {"parallel",         ConstraintKind::Parallel},
+        {"perpendicular",    ConstraintKind::Perpendicular},
+        {"horizontal",       ConstraintKind::Horizontal},
+        {"vertical",         ConstraintKind::Vertical},
+        {"angle",            ConstraintKind::Angle},
+        {"arc_line_tangent", ConstraintKind::ArcLineTangent},
+        {"pt_on_line",       ConstraintKind::PtOnLine},
+        {"pt_on_circle",     ConstraintKind::PtOnCircle},
+        {"symmetric_line",   ConstraintKind::SymmetricLine},
+    };
+    auto it = kinds.find(type);
+    return (it != kinds.end()) ? it->second : ConstraintKind::Count;
+}
+
+EaSession::EaSession()
+    : QObject()
+    , m_geometrySolver(nullptr)
+    , m_solverWorker(nullptr)
+    , m_solverWorkerStale(true)
+    , m_solverWorkerRevision(-1)
+    , m_solverWorkerSequence(0)
 {
 }
 
@@ -32,6 +59,7 @@ int EaSession::addPoint(double x, double y, double z)
     
     emit pointAdded(pointId, x, y, z);
     emit geometryChanged();
+    updateStructure();
     
     qDebug() << "EaSession: Added point" << pointId << "at" << x << y << z;
     return pointId;
@@ -148,6 +176,7 @@ void EaSession::removePoint(int pointId)
                                     return line->getStartPointId() == pointId || 
                                            line->getEndPointId() == pointId;
                                 }), m_lines.end());
+    updateStructure();
 }
 
 void EaSession::removeLine(int lineId)
@@ -162,6 +191,7 @@ void EaSession::removeLine(int lineId)
         emit lineRemoved(lineId);
         emit geometryChanged();
         qDebug() << "EaSession: Removed line" << lineId;
+        updateStructure();
     }
 }
 
@@ -202,6 +232,7 @@ void EaSession::clear()
     emit geometryChanged();
     emit selectionChanged();
     qDebug() << "EaSession: Cleared all geometry";
+    updateStructure();
 }
 
 void EaSession::createConstraint1()
@@ -309,6 +340,7 @@ void EaSession::updatePointPosition(int pointId, double x, double y, double z)
     EaPoint* point = getPoint(pointId);
     if (point) {
         point->setPosition(x, y, z);
+        m_solverWorkerStale = true;
         emit pointPositionChanged(pointId, x, y, z);
         emit geometryChanged();
         qDebug() << "EaSession: Updated point" << pointId << "position to" << x << y << z;
@@ -428,6 +460,7 @@ void EaSession::addDistanceConstraint(int point1Id, int point2Id, double distanc
     constraint.data["distance"] = distance;
     
     m_constraints.push_back(constraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added distance constraint" << constraint.id 
              << "between points" << point1Id << "and" << point2Id 
@@ -443,6 +476,7 @@ void EaSession::createFixPointConstraint(int pointId)
     fixConstraint.data["type"] = "SLVS_C_WHERE_DRAGGED";
     
     m_constraints.push_back(fixConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added fix point constraint" << fixConstraint.id 
              << "for point" << pointId;
@@ -466,6 +500,7 @@ void EaSession::addParallelConstraint(int line1Id, int line2Id)
     parallelConstraint.data["line2"] = line2Id;
     
     m_constraints.push_back(parallelConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added parallel constraint" << parallelConstraint.id 
              << "between lines" << line1Id << "and" << line2Id;
@@ -488,6 +523,7 @@ void EaSession::addPerpendicularConstraint(int line1Id, int line2Id)
     perpendicularConstraint.data["line2"] = line2Id;
     
     m_constraints.push_back(perpendicularConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added perpendicular constraint" << perpendicularConstraint.id 
              << "between lines" << line1Id << "and" << line2Id;
@@ -508,6 +544,7 @@ void EaSession::addHorizontalConstraint(int lineId)
     horizontalConstraint.data["line"] = lineId;
     
     m_constraints.push_back(horizontalConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added horizontal constraint" << horizontalConstraint.id 
              << "for line" << lineId;
@@ -528,6 +565,7 @@ void EaSession::addVerticalConstraint(int lineId)
     verticalConstraint.data["line"] = lineId;
 
     m_constraints.push_back(verticalConstraint);
+    updateStructure();
 
     qDebug() << "EaSession: Added vertical constraint" << verticalConstraint.id
              << "for line" << lineId;
@@ -551,6 +589,7 @@ void EaSession::addAngleConstraint(int line1Id, int line2Id, double angle)
     angleConstraint.data["angle"] = angle;
     
     m_constraints.push_back(angleConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added angle constraint" << angleConstraint.id 
              << "between lines" << line1Id << "and" << line2Id << "with angle" << angle << "degrees";
@@ -589,6 +628,7 @@ void EaSession::addArcLineTangentConstraint(int arcId, int lineId)
     tangentConstraint.data["line"] = lineId;
     
     m_constraints.push_back(tangentConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added arc-line tangent constraint" << tangentConstraint.id 
              << "between arc" << arcId << "and line" << lineId;
@@ -611,6 +651,7 @@ void EaSession::addPtOnLineConstraint(int pointId, int lineId)
     ptOnLineConstraint.data["line"] = lineId;
     
     m_constraints.push_back(ptOnLineConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added point on line constraint" << ptOnLineConstraint.id 
              << "for point" << pointId << "on line" << lineId;
@@ -634,6 +675,7 @@ void EaSession::addPtOnCircleConstraint(int pointId, int centerPointId, double r
     ptOnCircleConstraint.data["radius"] = radius;
     
     m_constraints.push_back(ptOnCircleConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added point on circle constraint" << ptOnCircleConstraint.id 
              << "for point" << pointId << "on circle with center" << centerPointId << "radius" << radius;
@@ -659,6 +701,7 @@ void EaSession::addSymmetricLineConstraint(int point1Id, int point2Id, int lineI
     symmetricLineConstraint.data["type"] = "SLVS_C_SYMMETRIC_LINE";
     
     m_constraints.push_back(symmetricLineConstraint);
+    updateStructure();
     
     qDebug() << "EaSession: Added symmetric line constraint" << symmetricLineConstraint.id 
              << "for points" << point1Id << "and" << point2Id << "about line" << lineId;
@@ -869,6 +912,7 @@ void EaSession::removeConstraint(int constraintId)
     if (it != m_constraints.end()) {
         m_constraints.erase(it);
         qDebug() << "EaSession: Removed constraint" << constraintId;
+        updateStructure();
     }
 }
 
@@ -877,6 +921,7 @@ void EaSession::clearConstraints()
     m_constraints.clear();
     m_nextConstraintId = 1;
     qDebug() << "EaSession: Cleared all constraints";
+    updateStructure();
 }
 
 std::vector<Constraint> EaSession::getConstraints() const
@@ -900,51 +945,17 @@ bool EaSession::solveDragConstraint(int draggedPointId, double newX, double newY
         qDebug() << "EaSession: Constraint" << i << ":" << constraint.id << constraint.type.c_str();
     }
     
-    // 构建点位置映射
-    std::map<std::string, std::map<std::string, std::any>> pointPositions;
-    for (const auto& point : m_points) {
-        std::map<std::string, std::any> pos;
-        pos["x"] = point->pos().x();
-        pos["y"] = point->pos().y();
-        pos["z"] = point->pos().z();
-        pointPositions[std::to_string(point->getId())] = pos;
-        qDebug() << "EaSession: Point" << point->getId() << "at" << point->pos().x() << point->pos().y() << point->pos().z();
-    }
-    
-    // 构建线段信息映射
-    std::map<std::string, std::map<std::string, std::any>> lineInfo;
-    for (const auto& line : m_lines) {
-        std::map<std::string, std::any> lineData;
-        lineData["startPoint"] = line->getStartPointId();
-        lineData["endPoint"] = line->getEndPointId();
-        lineInfo[std::to_string(line->getId())] = lineData;
-    }
+    // 同步点位置和线段信息
+    updateSolverInput();
     
     // 调用GeometrySolver进行求解
     bool success = m_geometrySolver->solveDragConstraint(draggedPointId, newX, newY, 
-                                                        pointPositions, m_constraints, lineInfo);
+                                                        m_solverInput, m_constraints);
     
     if (success) {
-        // 更新点的位置 - 使用动态方法处理所有点
-        QVariantMap solvedPoints = m_geometrySolver->getSolvedPoints(pointPositions);
-        
-        // 更新所有点的位置
-        for (const auto& point : m_points) {
-            int pointId = point->getId();
-            QString xKey = QString("x%1").arg(pointId);
-            QString yKey = QString("y%1").arg(pointId);
-            
-            if (solvedPoints.contains(xKey) && solvedPoints.contains(yKey)) {
-                double newX = solvedPoints[xKey].toDouble();
-                double newY = solvedPoints[yKey].toDouble();
-                
-                point->setPosition(newX, newY, 0.0);
-                
-                qDebug() << "EaSession: Updated point" << pointId << "to position" << newX << newY;
-            } else {
-                qWarning() << "EaSession: No solved position found for point" << pointId;
-            }
-        }
+        // 更新所有点的位置 - 快照里的点和 m_points 顺序相同，直接写回
+        m_geometrySolver->writeSolvedPoints(m_points);
+        m_solverWorkerStale = true;
         
         emit geometryChanged();
         qDebug() << "EaSession: Constraint solving successful for point" << draggedPointId;
@@ -955,6 +966,146 @@ bool EaSession::solveDragConstraint(int draggedPointId, double newX, double newY
     return success;
 }
 
+void EaSession::updateSolverInput()
+{
+    SolverInput& input = m_solverInput;
+    
+    // 检查点、线段和圆弧是否有增删，没有的话快照里的ID和端点下标都不用重建
+    bool same = (input.pointIds.size() == m_points.size() &&
+                 input.lineIds.size() == m_lines.size() &&
+                 input.arcIds.size() == m_arcs.size());
+    for (size_t i = 0; same && i < m_points.size(); i++) {
+        same = (input.pointIds[i] == m_points[i]->getId());
+    }
+    for (size_t i = 0; same && i < m_lines.size(); i++) {
+        const EaLine* line = m_lines[i].get();
+        same = (input.lineIds[i] == line->getId() &&
+                input.lineStart[i] >= 0 && input.pointIds[input.lineStart[i]] == line->getStartPointId() &&
+                input.lineEnd[i] >= 0 && input.pointIds[input.lineEnd[i]] == line->getEndPointId());
+    }
+    for (size_t i = 0; same && i < m_arcs.size(); i++) {
+        const EaPoint* center = m_arcs[i]->getCenter();
+        same = (input.arcIds[i] == m_arcs[i]->getId() && center &&
+                input.arcCenter[i] >= 0 && input.pointIds[input.arcCenter[i]] == center->getId());
+    }
+    
+    if (!same) {
+        // 点ID到下标的映射只在重建时用
+        std::map<int, int> pointIndex;
+        input.pointIds.resize(m_points.size());
+        for (size_t i = 0; i < m_points.size(); i++) {
+            input.pointIds[i] = m_points[i]->getId();
+            pointIndex[input.pointIds[i]] = (int)i;
+        }
+        
+        input.lineIds.resize(m_lines.size());
+        input.lineStart.resize(m_lines.size());
+        input.lineEnd.resize(m_lines.size());
+        for (size_t i = 0; i < m_lines.size(); i++) {
+            const EaLine* line = m_lines[i].get();
+            auto start = pointIndex.find(line->getStartPointId());
+            auto end = pointIndex.find(line->getEndPointId());
+            input.lineIds[i] = line->getId();
+            input.lineStart[i] = (start != pointIndex.end()) ? start->second : -1;
+            input.lineEnd[i] = (end != pointIndex.end()) ? end->second : -1;
+        }
+        
+        input.arcIds.resize(m_arcs.size());
+        input.arcCenter.resize(m_arcs.size());
+        for (size_t i = 0; i < m_arcs.size(); i++) {
+            const EaPoint* center = m_arcs[i]->getCenter();
+            auto it = center ? pointIndex.find(center->getId()) : pointIndex.end();
+            input.arcIds[i] = m_arcs[i]->getId();
+            input.arcCenter[i] = (it != pointIndex.end()) ? it->second : -1;
+        }
+        input.revision++;
+        qDebug() << "EaSession: Rebuilt solver input with" << m_points.size() << "points and" << m_lines.size() << "lines";
+    }
+    
+    // 坐标每次都原地复制
+    input.x.resize(m_points.size());
+    input.y.resize(m_points.size());
+    for (size_t i = 0; i < m_points.size(); i++) {
+        input.x[i] = m_points[i]->pos().x();
+        input.y[i] = m_points[i]->pos().y();
+    }
+    input.arcRadius.resize(m_arcs.size());
+    input.arcStart.resize(m_arcs.size());
+    input.arcEnd.resize(m_arcs.size());
+    for (size_t i = 0; i < m_arcs.size(); i++) {
+        input.arcRadius[i] = m_arcs[i]->getRadius();
+        input.arcStart[i] = m_arcs[i]->getStartAngle();
+        input.arcEnd[i] = m_arcs[i]->getEndAngle();
+    }
+}
+
+void EaSession::updateStructure()
+{
+    // 约束可能有增删，求解器要重新编译，求解线程还没送回的结果也作废
+    m_solverInput.revision++;
+    m_solverWorkerStale = true;
+    
+    // 几何或约束变化后只做结构分析，立即更新自由度，不需要等到下一次求解
+    if (!m_geometrySolver) {
+        return;
+    }
+    
+    updateSolverInput();
+    
+    if (!m_geometrySolver->analyzeStructure(m_solverInput, m_constraints)) {
+        qWarning() << "EaSession: Sketch is over-constrained";
+    }
+}
+
+bool EaSession::requestDragConstraint(int draggedPointId, double newX, double newY)
+{
+    if (!m_solverWorker) {
+        return false;
+    }
+    
+    // 点、线段或约束有变化，或者点被别的方式移动过，把新的快照交给求解线程
+    updateSolverInput();
+    if (m_solverWorkerStale || m_solverWorkerRevision != m_solverInput.revision) {
+        m_solverWorkerSequence++;
+        m_solverWorker->setSystem(m_solverInput, m_constraints, m_solverWorkerSequence);
+        m_solverWorkerStale = false;
+        m_solverWorkerRevision = m_solverInput.revision;
+    }
+    
+    m_solverWorker->requestDrag(draggedPointId, newX, newY);
+    return true;
+}
+
+void EaSession::onDragSolved(int sequence, int draggedPointId, bool success, const QVector<double>& positions)
+{
+    // 结果是在更早交接的系统上解出来的，或者之后点被移动过、有编辑，已经过时
+    if (sequence != m_solverWorkerSequence || m_solverWorkerStale ||
+        positions.size() != 2 * (int)m_points.size()) {
+        qDebug() << "EaSession: Dropped stale solve result for point" << draggedPointId;
+        return;
+    }
+    
+    if (!success) {
+        // 失败时被拖拽的点已经按简单拖拽移到了目标位置
+        qWarning() << "EaSession: Constraint solving failed for point" << draggedPointId;
+        return;
+    }
+    
+    // 快照里的点和 m_points 顺序相同，直接写回
+    for (size_t i = 0; i < m_points.size(); i++) {
+        m_points[i]->setPosition(positions[2 * i], positions[2 * i + 1], 0.0);
+    }
+    emit geometryChanged();
+}
+
+void EaSession::setSolverWorker(EaSolverWorker* worker)
+{
+    m_solverWorker = worker;
+    // 求解线程发出的信号以队列连接在界面线程中处理
+    connect(worker, &EaSolverWorker::solved, this, &EaSession::onDragSolved, Qt::QueuedConnection);
+    qDebug() << "EaSession: Solver worker set";
+}
+
 void EaSession::setGeometrySolver(GeometrySolver* solver)
 {
     m_geometrySolver = solver;
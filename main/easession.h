@@ -2,6 +2,7 @@
 #define EASESSION_H
 
 #include <QObject>
+#include <QVector>
 #include <vector>
 #include <memory>
 #include <map>
@@ -13,17 +14,59 @@
 #include "../geometry/eacircle.h"
 #include "../geometry/eaarc.h"
 
+// 约束种类，创建约束时由类型字符串确定一次，求解器按它查编译函数表
+enum class ConstraintKind {
+    Distance,
+    FixPoint,
+    DragPoint,
+    Parallel,
+    Perpendicular,
+    Horizontal,
+    Vertical,
+    Angle,
+    ArcLineTangent,
+    PtOnLine,
+    PtOnCircle,
+    SymmetricLine,
+    Count       // 种类数，也表示未知的类型
+};
+
+ConstraintKind constraintKindFromType(const std::string& type);
+
 // 约束结构体，替代QVariantMap
 struct Constraint {
     int id;
     std::string type;
+    ConstraintKind kind;
     std::map<std::string, std::any> data;
     
-    Constraint() : id(0) {}
-    Constraint(int id, const std::string& type) : id(id), type(type) {}
+    Constraint() : id(0), kind(ConstraintKind::Count) {}
+    Constraint(int id, const std::string& type) : id(id), type(type), kind(constraintKindFromType(type)) {}
+};
+
+// 求解器输入快照，替代按字符串键存放的 std::any 映射。按列存放，
+// 会话里只建一次，之后原地更新，拖拽时每帧不再分配内存
+struct SolverInput {
+    // 点：ID 和坐标，下标相同的是同一个点
+    std::vector<int> pointIds;
+    std::vector<double> x;
+    std::vector<double> y;
+    // 线段：ID 和起点、终点在点数组中的下标（端点不存在时为 -1）
+    std::vector<int> lineIds;
+    std::vector<int> lineStart;
+    std::vector<int> lineEnd;
+    // 圆弧：ID、圆心在点数组中的下标（圆心不存在时为 -1）、半径和起止角度（度）
+    std::vector<int> arcIds;
+    std::vector<int> arcCenter;
+    std::vector<double> arcRadius;
+    std::vector<double> arcStart;
+    std::vector<double> arcEnd;
+    // 点、线段或约束有增删时加一，求解器据此判断编译好的系统还能不能用
+    int revision = 0;
 };
 
 class GeometrySolver;
+class EaSolverWorker;
 
 class EaSession : public QObject
 {
@@ -76,9 +119,13 @@ public:
     
     // 拖拽约束求解
     bool solveDragConstraint(int draggedPointId, double newX, double newY);
+    // 把拖拽目标交给求解线程，不等待求解，结果到达后更新所有点；没有求解线程时返回 false
+    bool requestDragConstraint(int draggedPointId, double newX, double newY);
     
     // 设置GeometrySolver引用
     void setGeometrySolver(GeometrySolver* solver);
+    // 设置求解线程
+    void setSolverWorker(EaSolverWorker* worker);
     
 public slots:
     // 几何元素管理
@@ -124,9 +171,18 @@ signals:
     void pointPositionChanged(int pointId, double x, double y, double z);
     void selectionChanged();
 
+private slots:
+    // 求解线程的结果，在界面线程中处理
+    void onDragSolved(int sequence, int draggedPointId, bool success, const QVector<double>& positions);
+
 private:
     EaSession();
 
+    // 把点坐标和线段端点同步到求解器输入快照，点和线段没有增删时只复制坐标
+    void updateSolverInput();
+    // 编辑后做结构分析，更新自由度
+    void updateStructure();
+
     // 几何元素存储 - 统一容器
     std::vector<std::shared_ptr<EaShape>> m_shapes;
     
@@ -139,6 +195,9 @@ private:
     // 约束存储,
     std::vector<Constraint> m_constraints;
     
+    // 求解器输入快照
+    SolverInput m_solverInput;
+    
     // ID管理
     int m_nextPointId = 1;
     int m_nextLineId = 1;
@@ -152,6 +211,13 @@ private:
     
     // GeometrySolver引用
     GeometrySolver* m_geometrySolver;
+    
+    // 求解线程，以及它的系统是否需要重新设置（点的位置不是由它的结果改变的，
+    // 或者有编辑）；交给它的系统的快照版本和最近一次交接的序号
+    EaSolverWorker* m_solverWorker;
+    bool m_solverWorkerStale;
+    int m_solverWorkerRevision;
+    int m_solverWorkerSequence;
 
 private:
     static EaSession *instance;
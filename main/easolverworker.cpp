@@ -0,0 +1,93 @@
+﻿#include "easolverworker.h"
+#include "eageosolver.h"
+#include <QDebug>
+#include <QMetaObject>
+
+EaSolverWorker::EaSolverWorker(QObject *parent)
+    : QObject(parent)
+    , m_writeSlot(0)
+    , m_readSlot(2)
+    , m_latest(1)
+    , m_scheduled(false)
+    , m_systemChanged(false)
+    , m_nextSequence(0)
+    , m_sequence(0)
+{
+    // 求解器是子对象，随工作对象一起移到求解线程
+    m_solver = new GeometrySolver(this);
+    qRegisterMetaType<QVector<double>>("QVector<double>");
+}
+
+EaSolverWorker::~EaSolverWorker()
+{
+}
+
+void EaSolverWorker::setSystem(const SolverInput& input, const std::vector<Constraint>& constraints,
+                               int sequence)
+{
+    // 系统只在编辑后交接，这里加锁复制；之后提交的目标一定在这个系统上求解
+    std::lock_guard<std::mutex> lock(m_systemMutex);
+    m_nextInput = input;
+    m_nextConstraints = constraints;
+    m_nextSequence = sequence;
+    m_systemChanged.store(true, std::memory_order_release);
+}
+
+void EaSolverWorker::requestDrag(int draggedPointId, double x, double y)
+{
+    // 写到自己的槽里，再换成最新的目标；换回来的槽要么是求解线程没取走的旧目标，
+    // 要么是求解线程已经用完的槽，下次可以直接覆盖
+    DragRequest& request = m_slots[m_writeSlot];
+    request.pointId = draggedPointId;
+    request.x = x;
+    request.y = y;
+    m_writeSlot = m_latest.exchange(m_writeSlot | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    
+    // 求解线程还没有排上 process 调用时才投递，拖拽再快队列里也最多只有一个
+    if (!m_scheduled.exchange(true, std::memory_order_acq_rel)) {
+        QMetaObject::invokeMethod(this, "process", Qt::QueuedConnection);
+    }
+}
+
+bool EaSolverWorker::takeRequest(DragRequest& request)
+{
+    if (!(m_latest.load(std::memory_order_acquire) & FRESH)) {
+        return false;
+    }
+    m_readSlot = m_latest.exchange(m_readSlot, std::memory_order_acq_rel) & ~FRESH;
+    request = m_slots[m_readSlot];
+    return true;
+}
+
+void EaSolverWorker::process()
+{
+    // 先清除标志再取目标，之后提交的目标会再投递一次 process
+    m_scheduled.store(false, std::memory_order_release);
+    
+    DragRequest request;
+    while (takeRequest(request)) {
+        // 目标是在系统之后提交的，取到目标后一定能看到新系统
+        if (m_systemChanged.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(m_systemMutex);
+            m_input = m_nextInput;
+            m_constraints = m_nextConstraints;
+            m_sequence = m_nextSequence;
+            m_systemChanged.store(false, std::memory_order_relaxed);
+        }
+        
+        bool success = m_solver->solveDragConstraint(request.pointId, request.x, request.y,
+                                                     m_input, m_constraints);
+        // 失败时保留上一次解出来的坐标，下一个目标从这里开始求解，
+        // 界面上被拖拽的点已经按简单拖拽移到了目标位置
+        if (success) {
+            m_solver->writeSolvedPoints(m_input);
+        }
+        
+        m_positions.resize(2 * (int)m_input.pointIds.size());
+        for (size_t i = 0; i < m_input.pointIds.size(); i++) {
+            m_positions[2 * i] = m_input.x[i];
+            m_positions[2 * i + 1] = m_input.y[i];
+        }
+        emit solved(m_sequence, request.pointId, success, m_positions);
+    }
+}
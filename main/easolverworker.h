@@ -0,0 +1,77 @@
+﻿#ifndef EASOLVERWORKER_H
+#define EASOLVERWORKER_H
+
+#include <QObject>
+#include <QVector>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "easession.h"
+
+class GeometrySolver;
+
+/**
+ * @brief 拖拽求解线程 - 在单独的线程中求解拖拽，界面线程不等待求解
+ *
+ * 界面线程通过单槽邮箱提交拖拽目标，新目标覆盖还没有处理的旧目标，
+ * 求解慢的时候中间的目标直接丢弃，只解最新的；结果通过 solved 信号
+ * 以队列连接送回界面线程
+ */
+class EaSolverWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EaSolverWorker(QObject *parent = nullptr);
+    ~EaSolverWorker();
+
+    // 以下两个函数在界面线程中调用
+    // 设置要求解的系统，点、线段或约束有变化后，在下一次提交拖拽目标前调用；
+    // sequence 是这次交接的序号，之后的结果都带着它
+    void setSystem(const SolverInput& input, const std::vector<Constraint>& constraints,
+                   int sequence);
+    // 提交拖拽目标，覆盖还没有处理的目标，不加锁也不分配内存
+    void requestDrag(int draggedPointId, double x, double y);
+
+signals:
+    // 求解完成。sequence 是求解用的系统交接时的序号，positions 按快照中点的顺序
+    // 存放 x0, y0, x1, y1, ...，求解失败时是上一次解出来的坐标
+    void solved(int sequence, int draggedPointId, bool success, const QVector<double>& positions);
+
+private slots:
+    void process();
+
+private:
+    struct DragRequest {
+        int pointId;
+        double x;
+        double y;
+    };
+    bool takeRequest(DragRequest& request);
+
+    // 三缓冲的单槽邮箱：界面线程写好 m_slots[m_writeSlot] 后和 m_latest 交换，
+    // 求解线程有新目标时用 m_readSlot 和 m_latest 交换；m_latest 中的 FRESH 位
+    // 表示这个目标还没有被取走
+    static const int FRESH = 4;
+    DragRequest m_slots[3];
+    int m_writeSlot;                // 只在界面线程中使用
+    int m_readSlot;                 // 只在求解线程中使用
+    std::atomic<int> m_latest;
+    std::atomic<bool> m_scheduled;  // 是否已经投递了还没有开始的 process 调用
+
+    // 界面线程设置的新系统，求解线程在下一次求解前取走
+    std::mutex m_systemMutex;
+    std::atomic<bool> m_systemChanged;
+    SolverInput m_nextInput;
+    std::vector<Constraint> m_nextConstraints;
+    int m_nextSequence;
+
+    // 以下只在求解线程中使用：求解器和它的系统，快照中的坐标是上一次求解的结果
+    GeometrySolver* m_solver;
+    SolverInput m_input;
+    std::vector<Constraint> m_constraints;
+    int m_sequence;
+    QVector<double> m_positions;
+};
+
+#endif // EASOLVERWORKER_H